@@ -0,0 +1,183 @@
+// Deterministic synthetic images with a template planted at known positions,
+// each copy shifted in color and sprinkled with bad pixels
+
+var sizes = {
+    '720p': { width: 1280, height: 720 },
+    '1080p': { width: 1920, height: 1080 },
+    '4k': { width: 3840, height: 2160 }
+};
+
+module.exports = createCase;
+createCase.sizes = sizes;
+createCase.kinds = [ 'noise', 'ui', 'gradient' ];
+
+// xorshift, so that every run searches the same pixels
+function createRandom(seed) {
+    var state = seed >>> 0 || 1;
+    
+    return function (limit) {
+        state ^= state << 13;
+        state >>>= 0;
+        state ^= state >>> 17;
+        state ^= state << 5;
+        state >>>= 0;
+        
+        return state % limit;
+    };
+}
+
+function createImage(width, height) {
+    return {
+        width: width,
+        height: height,
+        channels: 3,
+        data: new Buffer(width * height * 3)
+    };
+}
+
+function fillRect(image, x, y, width, height, color) {
+    var row, col, i;
+    
+    for (row = y; row < y + height && row < image.height; row++) {
+        for (col = x; col < x + width && col < image.width; col++) {
+            i = (row * image.width + col) * 3;
+            image.data[i] = color[0];
+            image.data[i + 1] = color[1];
+            image.data[i + 2] = color[2];
+        }
+    }
+}
+
+function randomColor(random) {
+    return [ random(256), random(256), random(256) ];
+}
+
+function paintNoise(image, random) {
+    for (var i = 0; i < image.data.length; i++) {
+        image.data[i] = random(256);
+    }
+}
+
+// flat background, windows and buttons with one pixel borders, text-like
+// speckles inside
+function paintUi(image, random) {
+    var windows, x, y, width, height, i, j;
+    
+    fillRect(image, 0, 0, image.width, image.height, [ 236, 236, 236 ]);
+    
+    windows = Math.round(image.width * image.height / 40000);
+    
+    for (i = 0; i < windows; i++) {
+        width = 40 + random(Math.round(image.width / 4));
+        height = 20 + random(Math.round(image.height / 4));
+        x = random(image.width);
+        y = random(image.height);
+        
+        fillRect(image, x, y, width, height, [ 90, 90, 90 ]);
+        fillRect(image, x + 1, y + 1, width - 2, height - 2, randomColor(random));
+        
+        for (j = 0; j < width * height / 200; j++) {
+            fillRect(image, x + 2 + random(width), y + 2 + random(height), 1 + random(3), 1 + random(2), [ 20, 20, 20 ]);
+        }
+    }
+}
+
+// smooth color ramps with little noise on top
+function paintGradient(image, random) {
+    var row, col, i;
+    
+    for (row = 0; row < image.height; row++) {
+        for (col = 0; col < image.width; col++) {
+            i = (row * image.width + col) * 3;
+            image.data[i] = (col * 255 / image.width + random(4)) & 255;
+            image.data[i + 1] = (row * 255 / image.height + random(4)) & 255;
+            image.data[i + 2] = ((col + row) * 127 / (image.width + image.height) + random(4)) & 255;
+        }
+    }
+}
+
+// icon of flat shapes over noise, distinct enough not to match by chance
+function createTemplate(size, random) {
+    var template = createImage(size, size);
+    
+    paintNoise(template, random);
+    fillRect(template, size / 4, size / 4, size / 2, size / 2, randomColor(random));
+    fillRect(template, size / 3, size / 8, size / 3, size / 8, randomColor(random));
+    
+    return template;
+}
+
+function clamp(value) {
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+// copies template into image at (x, y), each channel shifted by up to
+// `drift` and `bad` pixels replaced by random colors
+function plant(image, template, x, y, drift, bad, random) {
+    var shift = [ random(2 * drift + 1) - drift, random(2 * drift + 1) - drift, random(2 * drift + 1) - drift ];
+    var row, col, c, i, j;
+    
+    // color differences of a pixel are summed over channels
+    while (Math.abs(shift[0]) + Math.abs(shift[1]) + Math.abs(shift[2]) > drift) {
+        shift[random(3)] = 0;
+    }
+    
+    for (row = 0; row < template.height; row++) {
+        for (col = 0; col < template.width; col++) {
+            i = ((y + row) * image.width + x + col) * 3;
+            j = (row * template.width + col) * 3;
+            
+            for (c = 0; c < 3; c++) {
+                image.data[i + c] = clamp(template.data[j + c] + shift[c]);
+            }
+        }
+    }
+    
+    for (i = 0; i < bad; i++) {
+        j = ((y + random(template.height)) * image.width + x + random(template.width)) * 3;
+        image.data[j] = image.data[j] ^ 0x80;
+    }
+}
+
+// Creates image of `kind` and `size` with `plants` copies of a template at
+// positions spread over the image, tolerances to pass to the search match
+// drift and bad pixels
+function createCase(kind, size, options) {
+    var random = createRandom(kind.length * 7919 + sizes[size].width);
+    var drift = options.drift;
+    var bad = options.bad;
+    var image = createImage(sizes[size].width, sizes[size].height);
+    var template = createTemplate(options.templateSize, random);
+    var positions = [];
+    var cols = Math.ceil(Math.sqrt(options.plants));
+    var i, cellWidth, cellHeight, x, y;
+    
+    if (kind === 'noise') {
+        paintNoise(image, random);
+    } else if (kind === 'ui') {
+        paintUi(image, random);
+    } else {
+        paintGradient(image, random);
+    }
+    
+    cellWidth = Math.floor(image.width / cols);
+    cellHeight = Math.floor(image.height / Math.ceil(options.plants / cols));
+    
+    for (i = 0; i < options.plants; i++) {
+        x = (i % cols) * cellWidth + random(cellWidth - template.width);
+        y = Math.floor(i / cols) * cellHeight + random(cellHeight - template.height);
+        
+        plant(image, template, x, y, drift, bad, random);
+        positions.push({ x: x, y: y });
+    }
+    
+    return {
+        kind: kind,
+        size: size,
+        image: image,
+        template: template,
+        positions: positions,
+        colorTolerance: drift,
+        pixelTolerance: bad
+    };
+}
@@ -0,0 +1,221 @@
+// End-to-end benchmark of imagesearch() over the synthetic corpus, with time
+// split between JS and native phases
+//
+//   npm run bench -- [--sizes=720p,1080p,4k] [--kinds=noise,ui,gradient]
+//                    [--runs=N] [--format=buffer|array] [--json]
+
+var async = require('async');
+var imagesearch = require('../');
+var binding = require('bindings')('search.node');
+var createCase = require('./corpus');
+
+var options = parseArgs(process.argv.slice(2));
+var cases = [];
+
+options.sizes.forEach(function (size) {
+    options.kinds.forEach(function (kind) {
+        cases.push({ kind: kind, size: size });
+    });
+});
+
+async.mapSeries(cases, function (item, callback) {
+    var corpus = createCase(item.kind, item.size, {
+        drift: 12,
+        bad: 6,
+        templateSize: 48,
+        plants: 4
+    });
+    
+    measure(corpus, options, callback);
+}, function (error, results) {
+    if (error) {
+        throw error;
+    }
+    
+    if (options.json) {
+        console.log(JSON.stringify({ runs: options.runs, format: options.format, results: results }, null, 2));
+    }
+});
+
+function parseArgs(args) {
+    var out = {
+        sizes: [ '720p', '1080p', '4k' ],
+        kinds: createCase.kinds,
+        runs: 5,
+        format: 'buffer',
+        json: false
+    };
+    
+    args.forEach(function (arg) {
+        var pair = arg.replace(/^--/, '').split('=');
+        
+        if (pair[0] === 'sizes' || pair[0] === 'kinds') {
+            out[pair[0]] = pair[1].split(',');
+        } else if (pair[0] === 'runs') {
+            out.runs = Math.max(1, parseInt(pair[1], 10));
+        } else if (pair[0] === 'format') {
+            out.format = pair[1];
+        } else if (pair[0] === 'json') {
+            out.json = true;
+        } else {
+            throw new Error('Unknown argument ' + arg);
+        }
+    });
+    
+    out.sizes = out.sizes.filter(function (size) {
+        return size in createCase.sizes;
+    });
+    
+    return out;
+}
+
+function elapsed(start) {
+    var diff = process.hrtime(start);
+    
+    return diff[0] * 1e3 + diff[1] / 1e6;
+}
+
+function median(values) {
+    var sorted = values.slice().sort(function (a, b) {
+        return a - b;
+    });
+    
+    return sorted[Math.floor(sorted.length / 2)];
+}
+
+// pixels as a plain array make the JS side split them into planes
+function withFormat(image, format) {
+    if (format !== 'array') {
+        return image;
+    }
+    
+    return {
+        width: image.width,
+        height: image.height,
+        channels: image.channels,
+        data: Array.prototype.slice.call(image.data)
+    };
+}
+
+function nativeMatrix(image) {
+    return {
+        rows: image.height,
+        cols: image.width,
+        channels: image.channels,
+        data: image.data
+    };
+}
+
+function nativeOptions(focus) {
+    return {
+        threads: 1,
+        prefilter: 0,
+        pyramid: 1,
+        fft: false,
+        focus: focus,
+        maxResults: 0,
+        firstMatch: false
+    };
+}
+
+// Times the whole imagesearch() call, the native scan alone and the scan
+// followed by suppression and sorting. JS time is what the whole call spends
+// beyond the native search: matrix creation, channel split and result mapping.
+function measure(corpus, options, callback) {
+    var image = withFormat(corpus.image, options.format);
+    var template = corpus.template;
+    var m1 = nativeMatrix(corpus.image);
+    var m2 = nativeMatrix(template);
+    var times = { total: [], scan: [], focused: [] };
+    var found = 0;
+    
+    // first run warms up caches and is not counted
+    async.timesSeries(options.runs + 1, function (run, next) {
+        async.series([
+            function (done) {
+                var start = process.hrtime();
+                
+                imagesearch(image, template, {
+                    colorTolerance: corpus.colorTolerance,
+                    pixelTolerance: corpus.pixelTolerance
+                }, function (error, result) {
+                    run > 0 && times.total.push(elapsed(start));
+                    found = countFound(result || [], corpus.positions);
+                    done(error);
+                });
+            },
+            function (done) {
+                var start = process.hrtime();
+                
+                binding.search(m1, m2, corpus.colorTolerance, corpus.pixelTolerance, nativeOptions(false), function (error) {
+                    run > 0 && times.scan.push(elapsed(start));
+                    done(error);
+                });
+            },
+            function (done) {
+                var start = process.hrtime();
+                
+                binding.search(m1, m2, corpus.colorTolerance, corpus.pixelTolerance, nativeOptions(true), function (error) {
+                    run > 0 && times.focused.push(elapsed(start));
+                    done(error);
+                });
+            }
+        ], next);
+    }, function (error) {
+        if (error) {
+            return callback(error);
+        }
+        
+        var total = median(times.total);
+        var scan = median(times.scan);
+        var focused = median(times.focused);
+        var result = {
+            kind: corpus.kind,
+            size: corpus.size,
+            width: corpus.image.width,
+            height: corpus.image.height,
+            planted: corpus.positions.length,
+            found: found,
+            totalMs: round(total),
+            scanMs: round(scan),
+            focusMs: round(Math.max(0, focused - scan)),
+            jsMs: round(Math.max(0, total - focused)),
+            opsPerSec: round(1000 / total)
+        };
+        
+        if ( ! options.json) {
+            console.log(pad(result.size, 6) + pad(result.kind, 10) +
+                'total ' + pad(result.totalMs + ' ms', 12) +
+                'scan ' + pad(result.scanMs + ' ms', 12) +
+                'focus ' + pad(result.focusMs + ' ms', 10) +
+                'js ' + pad(result.jsMs + ' ms', 10) +
+                pad(result.opsPerSec + ' ops/s', 16) +
+                'found ' + result.found + '/' + result.planted);
+        }
+        
+        callback(null, result);
+    });
+}
+
+// planted copies reported at their exact position
+function countFound(result, positions) {
+    return positions.filter(function (position) {
+        return result.some(function (match) {
+            return match.x === position.x && match.y === position.y;
+        });
+    }).length;
+}
+
+function round(value) {
+    return Math.round(value * 100) / 100;
+}
+
+function pad(value, width) {
+    value = String(value);
+    
+    while (value.length < width) {
+        value += ' ';
+    }
+    
+    return value;
+}
@@ -0,0 +1,270 @@
+// Microbenchmark of the native search over a grid of image and template
+// sizes, channel counts, tolerances and match densities. Prints JSON with
+// throughput in candidate positions per second.
+//
+//   bench [--isa=scalar,sse2,avx2,avx512bw] [--mode=plain,prefilter,fft,pyramid]
+//         [--threads=N] [--tries=N] [--quick]
+//
+// Every instruction set the CPU supports is run unless `--isa` picks some.
+// Dense matches are only searched for in images up to 640x480.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <bench/BenchTimer.h>
+
+#include "engine.h"
+
+typedef enum {
+    DENSITY_SPARSE,
+    DENSITY_GRID,
+    DENSITY_DENSE
+} Density;
+
+static const char *densityNames[] = { "sparse", "grid", "dense" };
+
+typedef struct {
+    unsigned int cols;
+    unsigned int rows;
+} Size;
+
+typedef struct {
+    unsigned int colorTolerance;
+    unsigned int pixelTolerance;
+} Tolerance;
+
+// interleaved pixels, 8 bits per sample
+typedef struct {
+    unsigned int cols;
+    unsigned int rows;
+    unsigned int channels;
+    std::vector<unsigned char> data;
+} Pixels;
+
+// xorshift, so that runs on different machines search the same pixels
+static unsigned int noise(unsigned int &state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    
+    return state;
+}
+
+static void fill(Pixels &p, unsigned int cols, unsigned int rows, unsigned int channels) {
+    p.cols = cols;
+    p.rows = rows;
+    p.channels = channels;
+    p.data.assign((size_t) cols * rows * channels, 0);
+}
+
+// Sparse images are noise holding the template once in the middle, grid
+// images repeat the template edge to edge, dense ones are flat like the
+// template, so that every position matches
+static void generate(Density density, const Size &image, const Size &tpl, unsigned int channels, Pixels &m1, Pixels &m2) {
+    unsigned int state = 2463534242u;
+    
+    fill(m1, image.cols, image.rows, channels);
+    fill(m2, tpl.cols, tpl.rows, channels);
+    
+    if (density == DENSITY_DENSE) {
+        std::fill(m1.data.begin(), m1.data.end(), 128);
+        std::fill(m2.data.begin(), m2.data.end(), 128);
+        return;
+    }
+    
+    for (size_t i = 0; i < m2.data.size(); i++) {
+        m2.data[i] = (unsigned char) noise(state);
+    }
+    
+    for (unsigned int y = 0; y < image.rows; y++) {
+        for (unsigned int x = 0; x < image.cols; x++) {
+            unsigned char *pixel = &m1.data[((size_t) y * image.cols + x) * channels];
+            
+            for (unsigned int c = 0; c < channels; c++) {
+                pixel[c] = (density == DENSITY_GRID) ?
+                    m2.data[((size_t) (y % tpl.rows) * tpl.cols + x % tpl.cols) * channels + c] :
+                    (unsigned char) noise(state);
+            }
+        }
+    }
+    
+    if (density == DENSITY_SPARSE) {
+        const unsigned int top = (image.rows - tpl.rows) / 2;
+        const unsigned int left = (image.cols - tpl.cols) / 2;
+        
+        for (unsigned int y = 0; y < tpl.rows; y++) {
+            memcpy(&m1.data[((size_t) (top + y) * image.cols + left) * channels],
+                &m2.data[(size_t) y * tpl.cols * channels], (size_t) tpl.cols * channels);
+        }
+    }
+}
+
+// same mapping as interleaved buffers passed to the addon
+static Matrix<unsigned char> view(const Pixels &p) {
+    typedef Matrix<unsigned char> M;
+    const unsigned char *data = &p.data[0];
+    const unsigned char *none = NULL;
+    const bool gray = p.channels < 3;
+    const bool alpha = p.channels == 2 || p.channels == 4;
+    
+    M out = {
+        p.rows,
+        p.cols,
+        p.channels,
+        M::map(gray ? data : none, p.rows, p.cols, p.channels),
+        M::map(gray ? none : data, p.rows, p.cols, p.channels),
+        M::map(gray ? none : data + 1, p.rows, p.cols, p.channels),
+        M::map(gray ? none : data + 2, p.rows, p.cols, p.channels),
+        M::map(alpha ? data + p.channels - 1 : none, p.rows, p.cols, p.channels)
+    };
+    
+    return out;
+}
+
+static std::vector<std::string> split(const char *list) {
+    std::vector<std::string> out;
+    std::string rest(list);
+    size_t comma;
+    
+    while ((comma = rest.find(',')) != std::string::npos) {
+        out.push_back(rest.substr(0, comma));
+        rest = rest.substr(comma + 1);
+    }
+    out.push_back(rest);
+    
+    return out;
+}
+
+static bool option(const char *arg, const char *name, const char **value) {
+    const size_t length = strlen(name);
+    
+    if (strncmp(arg, name, length) || arg[length] != '=') {
+        return false;
+    }
+    
+    *value = arg + length + 1;
+    
+    return true;
+}
+
+int main(int argc, char **argv) {
+    std::vector<std::string> isas;
+    std::vector<std::string> modes(1, "plain");
+    unsigned int threads = 1;
+    int tries = 3;
+    bool quick = false;
+    
+    for (int i = 1; i < argc; i++) {
+        const char *value;
+        
+        if (option(argv[i], "--isa", &value)) {
+            isas = split(value);
+        } else if (option(argv[i], "--mode", &value)) {
+            modes = split(value);
+        } else if (option(argv[i], "--threads", &value)) {
+            threads = (unsigned int) std::max(1, atoi(value));
+        } else if (option(argv[i], "--tries", &value)) {
+            tries = std::max(1, atoi(value));
+        } else if ( ! strcmp(argv[i], "--quick")) {
+            quick = true;
+        } else {
+            fprintf(stderr, "usage: %s [--isa=list] [--mode=list] [--threads=N] [--tries=N] [--quick]\n", argv[0]);
+            return 1;
+        }
+    }
+    
+    // kernels the CPU can run, widest last
+    if (isas.empty()) {
+        const char *all[] = { "scalar", "sse2", "avx2", "avx512bw" };
+        
+        for (unsigned int i = 0; i < 4; i++) {
+            if (strcmp(selectKernel(all[i]), all[i]) == 0) {
+                isas.push_back(all[i]);
+            }
+        }
+    }
+    
+    const Size fullImages[] = { { 320, 240 }, { 640, 480 }, { 1920, 1080 } };
+    const Size fullTemplates[] = { { 8, 8 }, { 24, 24 }, { 64, 64 } };
+    const Size quickImages[] = { { 320, 240 } };
+    const Size quickTemplates[] = { { 8, 8 }, { 24, 24 } };
+    const unsigned int channels[] = { 1, 3, 4 };
+    const Tolerance tolerances[] = { { 0, 0 }, { 24, 0 }, { 24, 16 } };
+    
+    const Size *images = quick ? quickImages : fullImages;
+    const Size *templates = quick ? quickTemplates : fullTemplates;
+    const unsigned int imageCount = quick ? 1 : 3;
+    const unsigned int templateCount = quick ? 2 : 3;
+    
+    Pool pool(threads);
+    Eigen::BenchTimer timer;
+    bool first = true;
+    
+    printf("{\n  \"threads\": %u,\n  \"tries\": %d,\n  \"results\": [", threads, tries);
+    
+    for (size_t k = 0; k < isas.size(); k++) {
+        const char *isa = selectKernel(isas[k].c_str());
+        
+        if (isas[k] != isa) {
+            fprintf(stderr, "skipping unsupported instruction set %s\n", isas[k].c_str());
+            continue;
+        }
+        
+        for (size_t m = 0; m < modes.size(); m++) {
+            SearchOptions options = SearchOptions();
+            options.threads = threads;
+            options.prefilter = (modes[m] == "prefilter") ? 2 : 0;
+            options.fft = modes[m] == "fft";
+            options.pyramid = (modes[m] == "pyramid") ? 3 : 1;
+            
+            for (unsigned int i = 0; i < imageCount; i++) {
+                for (unsigned int t = 0; t < templateCount; t++) {
+                    for (unsigned int c = 0; c < 3; c++) {
+                        for (unsigned int d = 0; d < 3; d++) {
+                            // every dense position is compared in full, large
+                            // images would take minutes
+                            if (d == DENSITY_DENSE && images[i].cols * images[i].rows > 640 * 480) {
+                                continue;
+                            }
+                            
+                            Pixels m1;
+                            Pixels m2;
+                            generate((Density) d, images[i], templates[t], channels[c], m1, m2);
+                            
+                            const Matrix<unsigned char> image = view(m1);
+                            const Matrix<unsigned char> tpl = view(m2);
+                            const double positions = (double) (m1.rows - m2.rows + 1) * (m1.cols - m2.cols + 1);
+                            
+                            for (unsigned int l = 0; l < 3; l++) {
+                                options.colorTolerance = tolerances[l].colorTolerance * (channels[c] < 3 ? 1 : 3);
+                                options.pixelTolerance = tolerances[l].pixelTolerance;
+                                
+                                size_t matches = 0;
+                                BENCH(timer, tries, 1, matches = (options.pyramid > 1 ?
+                                    pyramidSearch(image, tpl, options, &pool) : search(image, tpl, options, &pool)).size());
+                                
+                                const double seconds = timer.best(Eigen::REAL_TIMER);
+                                
+                                printf("%s\n    { \"isa\": \"%s\", \"mode\": \"%s\", \"image\": [%u, %u], \"template\": [%u, %u], "
+                                    "\"channels\": %u, \"colorTolerance\": %u, \"pixelTolerance\": %u, \"density\": \"%s\", "
+                                    "\"matches\": %lu, \"seconds\": %.6f, \"positionsPerSecond\": %.0f }",
+                                    first ? "" : ",", isa, modes[m].c_str(), m1.cols, m1.rows, m2.cols, m2.rows,
+                                    channels[c], options.colorTolerance, options.pixelTolerance, densityNames[d],
+                                    (unsigned long) matches, seconds, seconds > 0 ? positions / seconds : 0.0);
+                                fflush(stdout);
+                                first = false;
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    
+    printf("\n  ]\n}\n");
+    
+    return 0;
+}
@@ -1,9 +1,71 @@
 {
+    "variables": {
+        "build_bench%": 0,
+        "usdt%": 0
+    },
     "targets": [{
         "target_name": "search",
-        "sources": [ "src/search.cc" ],
+        "sources": [ "src/search.cc", "src/template.cc", "src/image.cc", "src/handle.cc", "src/metrics.cc", "src/kernel.cc", "src/pool.cc" ],
         "include_dirs": [
             "deps/eigen"
+        ],
+        "conditions": [
+            [ "target_arch=='ia32' or target_arch=='x64'", {
+                "dependencies": [ "kernel_sse2", "kernel_avx2", "kernel_avx512bw" ]
+            }],
+            [ "usdt==1", {
+                "defines": [ "IMAGESEARCH_USDT" ]
+            }]
         ]
-    }]
+    }],
+    "conditions": [
+        [ "target_arch=='ia32' or target_arch=='x64'", {
+            "targets": [{
+                "target_name": "kernel_sse2",
+                "type": "static_library",
+                "sources": [ "src/kernel_sse2.cc" ],
+                "cflags": [ "-fPIC", "-msse2" ],
+                "xcode_settings": {
+                    "OTHER_CFLAGS": [ "-msse2" ]
+                }
+            }, {
+                "target_name": "kernel_avx2",
+                "type": "static_library",
+                "sources": [ "src/kernel_avx2.cc" ],
+                "cflags": [ "-fPIC", "-mavx2", "-mpopcnt" ],
+                "xcode_settings": {
+                    "OTHER_CFLAGS": [ "-mavx2", "-mpopcnt" ]
+                }
+            }, {
+                "target_name": "kernel_avx512bw",
+                "type": "static_library",
+                "sources": [ "src/kernel_avx512bw.cc" ],
+                "cflags": [ "-fPIC", "-mavx512f", "-mavx512bw", "-mpopcnt" ],
+                "xcode_settings": {
+                    "OTHER_CFLAGS": [ "-mavx512f", "-mavx512bw", "-mpopcnt" ]
+                }
+            }]
+        }],
+        [ "build_bench==1", {
+            "targets": [{
+                "target_name": "bench",
+                "type": "executable",
+                "sources": [ "bench/native.cc", "src/kernel.cc", "src/pool.cc" ],
+                "include_dirs": [
+                    "src",
+                    "deps/eigen"
+                ],
+                "defines": [ "IMAGESEARCH_BENCH" ],
+                "libraries": [ "-lpthread" ],
+                "conditions": [
+                    [ "target_arch=='ia32' or target_arch=='x64'", {
+                        "dependencies": [ "kernel_sse2", "kernel_avx2", "kernel_avx512bw" ]
+                    }],
+                    [ "OS=='linux'", {
+                        "libraries": [ "-lrt" ]
+                    }]
+                ]
+            }]
+        }]
+    ]
 }
@@ -1,9 +1,18 @@
-var searchNative = require('bindings')('search.node').search;
+var binding = require('bindings')('search.node');
+var searchNative = binding.search;
+var searchManyNative = binding.searchMany;
+var NativeTemplate = binding.Template;
+var NativeImage = binding.Image;
 
 module.exports = imagesearch;
+imagesearch.prepare = prepareTemplate;
+imagesearch.prepareImage = prepareImage;
+imagesearch.searchMany = searchMany;
+imagesearch.setPoolSize = setPoolSize;
+imagesearch.getMetrics = getMetrics;
 
 function imagesearch(image, template, options, callback) {
-    var error, colorTolerance, pixelTolerance, imgMatrix, tplMatrix, result;
+    var error, type, colorTolerance, pixelTolerance, nativeOptions, imgMatrix, tplMatrix, result;
     
     if (typeof options === 'function') {
         callback = options;
@@ -14,22 +23,34 @@ function imagesearch(image, template, options, callback) {
         return;
     }
     
-        if (error = prepare(image, 'image')) {
+    type = searchType([ image, template ]);
+    
+    if ((error = prepare(image, 'image', type))) {
         return callback(error);
     }
     
-    if (error = prepare(template, 'template')) {
+    if ((error = prepare(template, 'template', type))) {
         return callback(error);
     }
     
     colorTolerance = options && options.colorTolerance || 0;
     pixelTolerance = options && options.pixelTolerance || 0;
+    nativeOptions = createOptions(options);
+    
+    if (options && typeof options.onMatches === 'function') {
+        nativeOptions.onMatches = createStream(options.onMatches);
+    }
     
-    imgMatrix = createMatrix(image);
-    tplMatrix = createMatrix(template);
+    imgMatrix = isPreparedImage(image) ? image : createMatrix(image, type);
+    tplMatrix = isPrepared(template) ? template : createMatrix(template, type);
     
-    searchNative(imgMatrix, tplMatrix, colorTolerance, pixelTolerance, function (error, result) {
-        result = focus(result, tplMatrix);
+    // overlapping matches are suppressed and the rest sorted by accuracy
+    // natively, off the event loop, returned handle cancels the search
+    return searchNative(imgMatrix, tplMatrix, colorTolerance, pixelTolerance, nativeOptions, function (error, result, stats) {
+        // packed matches come as typed arrays in x, y order already
+        if (nativeOptions.packed) {
+            return callback(error, result, stats);
+        }
         
         result = result.map(function (match) {
             return {
@@ -39,21 +60,155 @@ function imagesearch(image, template, options, callback) {
             };
         });
         
-        result.sort(function (obj1, obj2) {
-            return obj1.accuracy - obj2.accuracy;
+        // search cut short passes an error and matches found until then,
+        // statistics come last when asked for
+        callback(error, result, stats);
+    });
+}
+
+// Searches for several templates in a single pass over the image, matches
+// carry index of their template
+function searchMany(image, templates, options, callback) {
+    var error, type, colorTolerance, pixelTolerance, nativeOptions, imgMatrix, tplMatrices, i;
+    
+    if (typeof options === 'function') {
+        callback = options;
+        options = null;
+    }
+    
+    if (typeof callback !== 'function') {
+        return;
+    }
+    
+    type = searchType([ image ].concat(Array.isArray(templates) ? templates : []));
+    
+    if ((error = prepare(image, 'image', type))) {
+        return callback(error);
+    }
+    
+    if ( ! Array.isArray(templates)) {
+        return callback(new Error('Bad templates array'));
+    }
+    
+    for (i = 0; i < templates.length; i++) {
+        if ((error = prepare(templates[i], 'template', type))) {
+            return callback(error);
+        }
+    }
+    
+    colorTolerance = options && options.colorTolerance || 0;
+    pixelTolerance = options && options.pixelTolerance || 0;
+    nativeOptions = createOptions(options);
+    
+    imgMatrix = isPreparedImage(image) ? image : createMatrix(image, type);
+    tplMatrices = templates.map(function (template) {
+        return isPrepared(template) ? template : createMatrix(template, type);
+    });
+    
+    return searchManyNative(imgMatrix, tplMatrices, colorTolerance, pixelTolerance, nativeOptions, function (error, result) {
+        if (nativeOptions.packed) {
+            return callback(error, result);
+        }
+        
+        result = result.map(function (match) {
+            return {
+                x: match.col,
+                y: match.row,
+                accuracy: match.accuracy,
+                template: match.template
+            };
         });
         
-        callback(null, result);
+        // search cut short passes an error and matches found until then
+        callback(error, result);
     });
 }
 
+// Maps batches of matches streamed from the native search, returning false
+// from `onMatches` cancels the search
+function createStream(onMatches) {
+    return function (matches) {
+        return onMatches(matches.map(function (match) {
+            return {
+                x: match.col,
+                y: match.row,
+                accuracy: match.accuracy
+            };
+        }));
+    };
+}
+
+// Sizes the pool of threads running searches, before the first search
+function setPoolSize(size) {
+    return binding.setPoolSize(size);
+}
+
+// Process-wide search counters in Prometheus text format
+function getMetrics() {
+    return binding.getMetrics();
+}
+
+function createOptions(options) {
+    return {
+        threads: options && options.threads || 1,
+        prefilter: options && options.prefilter || 0,
+        pyramid: options && options.pyramid || 1,
+        fft: !!(options && options.fft),
+        focus: true,
+        maxResults: options && options.maxResults || 0,
+        firstMatch: !!(options && options.firstMatch),
+        mask: !!(options && options.mask),
+        batch: options && options.batch || 0,
+        batchWindow: options && options.batchWindow || 0,
+        deadlineMs: options && options.deadlineMs || 0,
+        packed: !!(options && options.packed),
+        stats: !!(options && options.stats)
+    };
+}
+
+// Copies template pixels once for repeated searches
+function prepareTemplate(template) {
+    var error = prepare(template, 'template');
+    
+    if (error) {
+        throw error;
+    }
+    
+    return new NativeTemplate(createMatrix(template, searchType([ template ])));
+}
+
+// Copies image pixels once for searches of many templates
+function prepareImage(image) {
+    var error = prepare(image, 'image');
+    
+    if (error) {
+        throw error;
+    }
+    
+    return new NativeImage(createMatrix(image, searchType([ image ])));
+}
+
+function isPrepared(template) {
+    return typeof NativeTemplate === 'function' && template instanceof NativeTemplate;
+}
+
+function isPreparedImage(image) {
+    return typeof NativeImage === 'function' && image instanceof NativeImage;
+}
+
 function hop(obj, prop) {
     return obj && obj.hasOwnProperty(prop);
 }
 
-function prepare(image, name) {
+// Checks an image or template object, and with `type` given that its samples
+// can be searched as that type
+function prepare(image, name, type) {
     var pixelLength;
     
+    if (type && (name === 'image' ? isPreparedImage(image) : isPrepared(image))) {
+        return (type && image.type !== type) ? new Error('Data type mismatch') : null;
+    }
+    
     if ( ! image) {
         return new Error('Bad '+ name +' object');
     } else if ( ! hop(image, 'data') || (image.data && ! ('length' in image.data))) {
@@ -72,96 +227,56 @@ function prepare(image, name) {
         if (image.width * image.height !== pixelLength) {
             return new Error('Bad '+ name +' dimensions');
         }
+        
+        // pixel buffers are searched as they are, other arrays are converted
+        if (type && isPixelBuffer(image.data) && sampleType(image) !== type) {
+            return new Error('Data type mismatch');
+        }
     }
     
     return null;
 }
 
-function focus(result, tplMatrix) {
-    var rows, cols, out;
-    var prevl, l, skip, ovps;
+// Sample type of a search, float when the image or a template has float
+// samples, 8-bit otherwise
+function searchType(images) {
+    for (var i = 0; i < images.length; i++) {
+        if (sampleType(images[i]) === 'float') {
+            return 'float';
+        }
+    }
     
-    rows = tplMatrix.rows;
-    cols = tplMatrix.cols;
+    return 'uint8';
+}
+
+// Prepared objects and pixel buffers have a sample type of their own, other
+// arrays are float as soon as a sample does not fit a byte
+function sampleType(image) {
+    var data, i, v;
     
-    if (result.length === 1) {
-        return result;
+    if (isPrepared(image) || isPreparedImage(image)) {
+        return image.type;
     }
     
-    if ( ! result.length) {
-        return [];
-    }
+    data = image && image.data;
     
-    out = result.reduce(function (prev, curr, i) {
-        if ( i === 1) {
-            prev = [ prev ];
-        }
-        
-        skip = false;
-        l = prev.length;
-        while (l--) {
-            prevl = prev[l];
-            ovps = overlaps(prevl, curr, rows, cols);
-            skip = skip || ovps;
-            
-            if (ovps && curr.accuracy < prevl.accuracy) {
-                prev[l] = curr;
-            }
-        }
-        
-        if ( ! skip) {
-            prev.push(curr);
-        }
-        
-        return prev;
-    });
+    if ( ! data || isPixelBuffer(data)) {
+        return (data instanceof Float32Array) ? 'float' : 'uint8';
+    }
     
-    out = out.reduce(function (prev, curr, i) {
-        if (i === 1) {
-            prev = [ prev ];
-        }
-        
-        l = prev.length;
-        skip = false;
-        while (l--) {
-            prevl = prev[l];
-            if (prevl.row === curr.row &&
-                prevl.col === curr.col &&
-                prevl.accuracy === curr.accuracy) {
-                    skip = true;
-                    break;
-            }
-        }
+    for (i = 0; i < data.length; i++) {
+        v = data[i];
         
-        if ( ! skip) {
-            prev.push(curr);
+        if (typeof v === 'number' && v !== (v & 255)) {
+            return 'float';
         }
-        
-        return prev;
-    });
-    
-    return out;
-}
-
-function overlaps(a, b, r, c) {
-    var ac = a.col;
-    var ar = a.row;
-    var bc = b.col;
-    var br = b.row;
-    
-    var bw = c + bc;
-    var bh = r + br;
-    var aw = c + ac;
-    var ah = r + ar;
+    }
     
-    return ((bw < bc || bw > ac) &&
-            (bh < br || bh > ar) &&
-            (aw < ac || aw > bc) &&
-            (ah < ar || ah > br));
+    return 'uint8';
 }
 
-function createMatrix(image) {
-    var channels, length, out;
+function createMatrix(image, type) {
+    var channels, length, out, Plane;
     
     channels = image.channels;
     length = image.data.length / channels;
@@ -172,10 +287,17 @@ function createMatrix(image) {
         channels: channels
     };
     
+    // pixel buffers are read in place by the native search
+    if (isPixelBuffer(image.data)) {
+        out.data = image.data;
+        return out;
+    }
+    
+    Plane = (type === 'float') ? Float32Array : Uint8Array;
     out.data = new Array(channels);
     var l = out.data.length;
     while (l--) {
-        out.data[l] = new Float32Array(length);
+        out.data[l] = new Plane(length);
     }
     
     split(image.data, out.data);
@@ -183,6 +305,13 @@ function createMatrix(image) {
     return out;
 }
 
+function isPixelBuffer(data) {
+    return Buffer.isBuffer(data) ||
+        data instanceof Uint8Array ||
+        data instanceof Float32Array ||
+        (typeof Uint8ClampedArray !== 'undefined' && data instanceof Uint8ClampedArray);
+}
+
 function split(raw, out) {
     var channels, i, k, l, j;
     
@@ -0,0 +1,74 @@
+// Image fixtures shared by the specs, 8-bit RGB samples interleaved in a
+// Buffer unless noted otherwise
+
+// Gradient with no two template sized blocks alike
+exports.makeImage = function (cols, rows) {
+    var data = new Buffer(cols * rows * 3);
+    for (var i = 0; i < data.length; i++) {
+        data[i] = (i * 31 + (i >> 5) * 17) % 256;
+    }
+    return data;
+};
+
+// Park-Miller noise in [0, 216), which leaves room to drift every sample of
+// a planted copy up by `DRIFT_MAX`
+exports.DRIFT_MAX = 39;
+
+exports.makeNoise = function (cols, rows, seed) {
+    var data = new Buffer(cols * rows * 3);
+    for (var i = 0; i < data.length; i++) {
+        seed = (seed * 16807) % 2147483647;
+        data[i] = seed % 216;
+    }
+    return data;
+};
+
+exports.crop = function (img, cols, x, y, width, height) {
+    var data = new Buffer(width * height * 3);
+    for (var r = 0; r < height; r++) {
+        img.copy(data, r * width * 3, ((y + r) * cols + x) * 3, ((y + r) * cols + x + width) * 3);
+    }
+    return data;
+};
+
+// Copies `tpl` into `img` at (x, y) with every sample raised by `drift`, and
+// `bad` pixels spread over the copy pushed 120 off in every channel
+exports.plant = function (img, cols, tpl, width, x, y, drift, bad) {
+    var height = tpl.length / width / 3;
+    var pixels = width * height;
+    var off = {};
+    
+    for (var k = 0; k < bad; k++) {
+        off[Math.floor((k + 0.5) * pixels / bad)] = true;
+    }
+    
+    for (var p = 0; p < pixels; p++) {
+        var to = ((y + Math.floor(p / width)) * cols + x + p % width) * 3;
+        
+        for (var j = 0; j < 3; j++) {
+            var v = tpl[p * 3 + j];
+            img[to + j] = off[p] ? (v < 128 ? v + 120 : v - 120) : v + drift;
+        }
+    }
+};
+
+// Planes of interleaved samples, as the native search takes them
+exports.split = function (raw, channels) {
+    var out = [];
+    for (var j = 0; j < channels; j++) {
+        out[j] = new Uint8Array(raw.length / channels);
+        for (var i = j, k = 0; i < raw.length; i += channels, k++) {
+            out[j][k] = raw[i];
+        }
+    }
+    return out;
+};
+
+// [row, col] of matches in scan order, for comparing with planted copies
+exports.positions = function (result) {
+    return result.map(function (match) {
+        return [ match.row, match.col ];
+    }).sort(function (a, b) {
+        return a[0] - b[0] || a[1] - b[1];
+    });
+};
@@ -0,0 +1,99 @@
+var binding = require('../build/Release/search');
+var search = binding.search;
+var Image = binding.Image;
+var Template = binding.Template;
+var assert = require('assert');
+var fixtures = require('./fixtures');
+
+describe('Image(matrix)', function () {
+    // odd width leaves padding at the end of each copied row
+    var img = fixtures.makeImage(81, 60);
+    var tpl = fixtures.crop(img, 81, 21, 13, 32, 24);
+    
+    tpl[0] = 0;
+    tpl[100] = 255;
+    
+    it('should throw error if "matrix" is not object', function () {
+        assert.throws(function () {
+            new Image();
+        }, /Bad argument 'matrix'/);
+    });
+    
+    it('should throw error if "matrix.data" is too short', function () {
+        assert.throws(function () {
+            new Image({ rows: 2, cols: 2, channels: 3, data: new Buffer(3) });
+        }, /Bad argument 'matrix.data'/);
+    });
+    
+    it('should expose matrix dimensions', function () {
+        var prepared = new Image({ rows: 60, cols: 81, channels: 3, data: img });
+        
+        assert.strictEqual(prepared.rows, 60);
+        assert.strictEqual(prepared.cols, 81);
+        assert.strictEqual(prepared.channels, 3);
+    });
+    
+    [ 'interleaved', 'planar' ].forEach(function (layout) {
+        [ {}, { prefilter: 4 }, { fft: true }, { pyramid: 3 } ].forEach(function (options) {
+            it('should return the same matches as ' + layout + ' image data with ' + JSON.stringify(options), function (done) {
+                var data = layout === 'planar' ? fixtures.split(img, 3) : img;
+                var prepared = new Image({ rows: 60, cols: 81, channels: 3, data: data });
+                
+                search({
+                    rows: 60, cols: 81, channels: 3, data: data
+                }, {
+                    rows: 24, cols: 32, channels: 3, data: tpl
+                }, 30, 2, options, function (error, plain) {
+                    search(prepared, {
+                        rows: 24, cols: 32, channels: 3, data: tpl
+                    }, 30, 2, options, function (error, result) {
+                        assert.deepEqual(result, plain);
+                        assert.strictEqual(result[0].row, 13);
+                        assert.strictEqual(result[0].col, 21);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+    
+    it('should not depend on source data once constructed', function (done) {
+        var data = new Buffer(img);
+        var prepared = new Image({ rows: 60, cols: 81, channels: 3, data: data });
+        
+        data.fill(0);
+        
+        search(prepared, {
+            rows: 24, cols: 32, channels: 3, data: tpl
+        }, 30, 2, function (error, result) {
+            assert.strictEqual(result[0].row, 13);
+            assert.strictEqual(result[0].col, 21);
+            done();
+        });
+    });
+    
+    it('should be shared by concurrent searches', function (done) {
+        var prepared = new Image({ rows: 60, cols: 81, channels: 3, data: img });
+        var template = new Template({ rows: 24, cols: 32, channels: 3, data: tpl });
+        var pending = 6;
+        
+        for (var i = 0; i < 6; i++) {
+            search(prepared, template, 30, 2, { prefilter: 4, fft: i % 2 === 0, threads: 2 }, function (error, result) {
+                assert.strictEqual(result[0].row, 13);
+                assert.strictEqual(result[0].col, 21);
+                
+                if ( ! --pending) {
+                    done();
+                }
+            });
+        }
+    });
+    
+    it('should throw error if data types differ', function () {
+        var prepared = new Image({ rows: 60, cols: 81, channels: 3, data: img });
+        
+        assert.throws(function () {
+            search(prepared, { rows: 24, cols: 32, channels: 3, data: new Float32Array(32 * 24 * 3) }, 0, 0);
+        }, /Data type mismatch/);
+    });
+});
@@ -17,7 +17,7 @@ describe('imagesearch(image, template, options, callback)', function () {
             '../build/Release/search': {
                 search: function () {
                     args = arguments;
-                    arguments[4](null, result);
+                    arguments[arguments.length - 1](null, result);
                 }
             }
         });
@@ -31,7 +31,7 @@ describe('imagesearch(image, template, options, callback)', function () {
         var imagesearch = createImagesearch({
             '../build/Release/search': {
                 search: function () {
-                    arguments[4](null, result);
+                    arguments[arguments.length - 1](null, result);
                 }
             }
         });
@@ -41,6 +41,19 @@ describe('imagesearch(image, template, options, callback)', function () {
         });
     }
     
+    function makeSearch(search) {
+        return createImagesearch({
+            bindings: function () {
+                return {
+                    search: function () {
+                        search.apply(null, arguments);
+                        arguments[arguments.length - 1](null, []);
+                    }
+                };
+            }
+        });
+    }
+    
     function testError(message, image, template, callback) {
         imagesearch(image, template, function (error, result) {
             
@@ -93,6 +106,260 @@ describe('imagesearch(image, template, options, callback)', function () {
         });
     });
     
+    it('should default "options.threads" to 1', function (done) {
+        var result = [{ row: 0, col: 0, accuracy: 123.456789 }];
+        
+        makeArgumentsTest(result, function (args, result) {
+            assert.strictEqual(args[4].threads, 1);
+            done();
+        });
+    });
+    
+    it('should default "options.maxResults" to 0', function (done) {
+        var result = [{ row: 0, col: 0, accuracy: 123.456789 }];
+        
+        makeArgumentsTest(result, function (args, result) {
+            assert.strictEqual(args[4].maxResults, 0);
+            assert.strictEqual(args[4].firstMatch, false);
+            done();
+        });
+    });
+    
+    it('should default "options.batch" to 0', function (done) {
+        var result = [{ row: 0, col: 0, accuracy: 123.456789 }];
+        
+        makeArgumentsTest(result, function (args, result) {
+            assert.strictEqual(args[4].batch, 0);
+            assert.strictEqual(args[4].batchWindow, 0);
+            done();
+        });
+    });
+    
+    it('should default "options.mask" to false', function (done) {
+        var result = [{ row: 0, col: 0, accuracy: 123.456789 }];
+        
+        makeArgumentsTest(result, function (args, result) {
+            assert.strictEqual(args[4].mask, false);
+            done();
+        });
+    });
+    
+    it('should return handle of native search and pass its error', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var handle = { cancel: function () {} };
+        var error = new Error('Search cancelled');
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function () {
+                        arguments[arguments.length - 1](error, [{ row: 1, col: 2, accuracy: 3 }]);
+                        return handle;
+                    }
+                };
+            }
+        });
+        
+        var result = imagesearch(image, image, { deadlineMs: 5 }, function (err, result) {
+            assert.strictEqual(err, error);
+            assert.deepEqual(result, [{ x: 2, y: 1, accuracy: 3 }]);
+        });
+        
+        assert.strictEqual(result, handle);
+        done();
+    });
+    
+    it('should pass packed result as is', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var packed = { length: 0, positions: [], accuracy: [] };
+        var options;
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function (m1, m2, colorTolerance, pixelTolerance, nativeOptions, callback) {
+                        options = nativeOptions;
+                        callback(null, packed);
+                    }
+                };
+            }
+        });
+        
+        imagesearch(image, image, { packed: true }, function (err, result) {
+            assert.strictEqual(options.packed, true);
+            assert.strictEqual(result, packed);
+            done();
+        });
+    });
+    
+    it('should map streamed matches and pass back return value', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function (m1, m2, colorTolerance, pixelTolerance, nativeOptions, callback) {
+                        assert.strictEqual(nativeOptions.onMatches([{ row: 1, col: 2, accuracy: 3 }]), false);
+                        callback(null, []);
+                    }
+                };
+            }
+        });
+        
+        imagesearch(image, image, {
+            onMatches: function (matches) {
+                assert.deepEqual(matches, [{ x: 2, y: 1, accuracy: 3 }]);
+                return false;
+            }
+        }, function () {
+            done();
+        });
+    });
+    
+    it('should ask for stats and pass them on', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var stats = { candidates: 1 };
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function (m1, m2, colorTolerance, pixelTolerance, nativeOptions, callback) {
+                        assert.strictEqual(nativeOptions.stats, true);
+                        callback(null, [], stats);
+                    }
+                };
+            }
+        });
+        
+        imagesearch(image, image, { stats: true }, function (err, result, s) {
+            assert.strictEqual(s, stats);
+            done();
+        });
+    });
+    
+    it('should pass prepared template to native search as is', function (done) {
+        function Template() {
+            this.type = 'uint8';
+        }
+        
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var template = new Template();
+        var args;
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function () {
+                        args = arguments;
+                        arguments[arguments.length - 1](null, []);
+                    },
+                    Template: Template
+                };
+            }
+        });
+        
+        imagesearch(image, template, function (error, result) {
+            assert.ifError(error);
+            assert.strictEqual(args[1], template);
+            done();
+        });
+    });
+    
+    it('should pass prepared image to native search as is', function (done) {
+        function Image() {
+            this.type = 'uint8';
+        }
+        
+        var image = new Image();
+        var template = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var args;
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function () {
+                        args = arguments;
+                        arguments[arguments.length - 1](null, []);
+                    },
+                    Image: Image
+                };
+            }
+        });
+        
+        imagesearch(image, template, function (error, result) {
+            assert.ifError(error);
+            assert.strictEqual(args[0], image);
+            done();
+        });
+    });
+    
+    it('should search samples that do not fit a byte as float', function (done) {
+        var image = { width: 2, height: 1, channels: 1, data: [ 0.5, 300 ] };
+        var template = { width: 1, height: 1, channels: 1, data: [ 1 ] };
+        var args;
+        
+        makeSearch(function () {
+            args = arguments;
+        })(image, template, function (error, result) {
+            assert.ifError(error);
+            assert.ok(args[0].data[0] instanceof Float32Array);
+            assert.deepEqual([].slice.call(args[0].data[0]), [ 0.5, 300 ]);
+            assert.ok(args[1].data[0] instanceof Float32Array);
+            done();
+        });
+    });
+    
+    it('should keep 8-bit planes for byte samples', function (done) {
+        var image = { width: 2, height: 1, channels: 1, data: [ 0, 255 ] };
+        var args;
+        
+        makeSearch(function () {
+            args = arguments;
+        })(image, image, function (error, result) {
+            assert.ifError(error);
+            assert.ok(args[0].data[0] instanceof Uint8Array);
+            assert.ok(args[1].data[0] instanceof Uint8Array);
+            done();
+        });
+    });
+    
+    it('should return error if float template is searched in 8-bit image', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: new Buffer([ 1 ]) };
+        var template = { width: 1, height: 1, channels: 1, data: new Float32Array([ 1 ]) };
+        
+        assert.doesNotThrow(function () {
+            testError(/Data type mismatch/, image, template, done);
+        });
+    });
+    
+    it('should return error if prepared template type differs from image', function (done) {
+        function Template() {
+            this.type = 'float';
+        }
+        
+        var image = { width: 1, height: 1, channels: 1, data: new Buffer([ 1 ]) };
+        var called = false;
+        
+        var imagesearch = createImagesearch({
+            bindings: function () {
+                return {
+                    search: function () {
+                        called = true;
+                    },
+                    Template: Template
+                };
+            }
+        });
+        
+        imagesearch(image, new Template(), function (error, result) {
+            assert.throws(function () {
+                assert.ifError(error);
+            }, /Data type mismatch/);
+            assert.strictEqual(called, false);
+            done();
+        });
+    });
+    
     it('should return error if "image" is not object', function (done) {
         testError(/Bad image object/, null, null, done);
     });
@@ -145,7 +412,7 @@ describe('imagesearch(image, template, options, callback)', function () {
                 search: function () {
                     assert.strictEqual(arguments[0].channels, 3);
                     done();
-                    
+                
                 }
             }
         });
@@ -162,7 +429,7 @@ describe('imagesearch(image, template, options, callback)', function () {
                 search: function () {
                     assert.strictEqual(arguments[1].channels, 3);
                     done();
-                    
+                
                 }
             }
         });
@@ -204,20 +471,11 @@ describe('imagesearch(image, template, options, callback)', function () {
     
     //--
     
-    it('should focus overlaping results and return the most accurate', function (done) {
-        var image = { width: 4, height: 4, channels: 1, data: { length: 16 } };
-        var template = { width: 2, height: 2, channels: 1, data: { length: 4 } };
-        var result = [
-            { row: 0, col: 0, accuracy: 2 },
-            { row: 0, col: 2, accuracy: 1 },
-            { row: 1, col: 1, accuracy: 0 },
-            { row: 2, col: 0, accuracy: 1 },
-            { row: 2, col: 2, accuracy: 2 }
-        ];
-        var expected = [{ x: 1, y: 1, accuracy: 0 }];
+    it('should ask native search to focus overlaping results', function (done) {
+        var result = [{ row: 0, col: 0, accuracy: 123.456789 }];
         
-        makeResultTest(image, template, result, function (result) {
-            assert.deepEqual(result, expected);
+        makeArgumentsTest(result, function (args, result) {
+            assert.strictEqual(args[4].focus, true);
             done();
         });
     });
@@ -233,13 +491,13 @@ describe('imagesearch(image, template, options, callback)', function () {
         });
     });
     
-    it('should return result array sorted by "accuracy" descending', function (done) {
+    it('should keep result order of native search', function (done) {
         var image = { width: 2, height: 2, channels: 1, data: { length: 4 } };
         var template = { width: 1, height: 1, channels: 1, data: { length: 1 } };
         
         var result = [
-            { row: 0, col: 0, accuracy: 2 },
             { row: 1, col: 1, accuracy: 1 },
+            { row: 0, col: 0, accuracy: 2 },
             { row: 0, col: 1, accuracy: 3 }
         ];
         
@@ -254,5 +512,67 @@ describe('imagesearch(image, template, options, callback)', function () {
             done();
         })
     });
+
+});
+
+describe('imagesearch.searchMany(image, templates, options, callback)', function () {
+    function createSearchMany(searchMany) {
+        return sm.require('../lib/imagesearch', {
+            requires: {
+                bindings: function () {
+                    return {
+                        searchMany: searchMany
+                    };
+                }
+            }
+        }).searchMany;
+    }
+    
+    it('should return error if "templates" is not array', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        
+        imagesearch.searchMany(image, null, function (error, result) {
+            assert.throws(function () {
+                assert.ifError(error);
+            }, /Bad templates array/);
+            done();
+        });
+    });
     
+    it('should return error of the first bad template', function (done) {
+        var image = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        
+        imagesearch.searchMany(image, [ image, {} ], function (error, result) {
+            assert.throws(function () {
+                assert.ifError(error);
+            }, /Missing template data/);
+            done();
+        });
+    });
+    
+    it('should pass all templates to a single native search', function (done) {
+        var image = { width: 2, height: 2, channels: 1, data: { length: 4 } };
+        var template = { width: 1, height: 1, channels: 1, data: { length: 1 } };
+        var calls = 0;
+        
+        var searchMany = createSearchMany(function (imgMatrix, tplMatrices) {
+            calls++;
+            assert.strictEqual(tplMatrices.length, 2);
+            assert.strictEqual(tplMatrices[1].rows, 1);
+            arguments[arguments.length - 1](null, [
+                { row: 1, col: 0, accuracy: 0, template: 0 },
+                { row: 0, col: 1, accuracy: 1, template: 1 }
+            ]);
+        });
+        
+        searchMany(image, [ template, template ], function (error, result) {
+            assert.ifError(error);
+            assert.strictEqual(calls, 1);
+            assert.deepEqual(result, [
+                { x: 0, y: 1, accuracy: 0, template: 0 },
+                { x: 1, y: 0, accuracy: 1, template: 1 }
+            ]);
+            done();
+        });
+    });
 });
@@ -1,5 +1,7 @@
 var search = require('../build/Release/search').search;
+var isa = require('../build/Release/search').isa;
 var assert = require('assert');
+var fixtures = require('./fixtures');
 
 describe('search', function () {
     function makeKTest(img, tpl) {
@@ -210,6 +212,57 @@ describe('search', function () {
         });
     });
     
+    describe('mask', function () {
+        // opaque pixels 10, 20, 30 and 40 around transparent ones
+        var tpl = {
+            rows: 2, cols: 3, channels: 2,
+            data: new Buffer([ 10, 255, 99, 0, 20, 255, 30, 255, 40, 255, 77, 0 ])
+        };
+        
+        var img = {
+            rows: 3, cols: 4, channels: 1,
+            data: new Buffer([ 0, 0, 0, 0, 0, 10, 5, 20, 0, 30, 40, 6 ])
+        };
+        
+        it('should skip template pixels of zero alpha', function (done) {
+            search(img, tpl, 0, 0, { mask: true }, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].row, 1);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+        
+        it('should compare all pixels by default', function (done) {
+            search(img, tpl, 0, 0, function (error, result) {
+                assert.strictEqual(result.length, 0);
+                done();
+            });
+        });
+        
+        it('should count bad pixels among opaque ones only', function (done) {
+            search({
+                rows: 1, cols: 3, channels: 3,
+                data: new Buffer([ 255, 0, 0, 0, 255, 0, 0, 255, 0 ])
+            }, {
+                rows: 1, cols: 3, channels: 4,
+                data: new Buffer([ 255, 0, 0, 255, 1, 2, 3, 0, 0, 0, 255, 255 ])
+            }, 0, 1, { mask: true }, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                done();
+            });
+        });
+        
+        it('should return the same matches with prefilter, fft and pyramid', function (done) {
+            search(img, tpl, 0, 0, { mask: true, prefilter: 2, fft: true, pyramid: 3 }, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].row, 1);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+    });
+    
     describe('match square', function () {
         var kTest, rgbTest;
         
@@ -534,5 +587,888 @@ describe('search', function () {
                 done();
             });
         });
+        
+        describe('pixel tolerance boundary', function () {
+            // candidate at col 0 misses three pixels in its first row, the one
+            // at col 4 misses two in its last row, col 3 never matches
+            var img = [
+                11, 11, 11, 200, 10, 10, 10,
+                10, 10, 10, 200, 10, 10, 10,
+                10, 10, 10, 200, 10, 13, 11
+            ];
+            var tpl = [ 10, 10, 10, 10, 10, 10, 10, 10, 10 ];
+            
+            [
+                [ '8-bit', function (data) { return new Buffer(data); } ],
+                [ 'float', function (data) { return [ new Float32Array(data) ]; } ]
+            ].forEach(function (type) {
+                function run(pixelTolerance, callback) {
+                    search({
+                        rows: 3, cols: 7, channels: 1, data: type[1](img)
+                    }, {
+                        rows: 3, cols: 3, channels: 1, data: type[1](tpl)
+                    }, 0, pixelTolerance, callback);
+                }
+                
+                it('should reject candidates with more misses than tolerance (' + type[0] + ')', function (done) {
+                    run(1, function (error, result) {
+                        assert.strictEqual(result.length, 0);
+                        done();
+                    });
+                });
+                
+                it('should return candidates with misses at tolerance in full (' + type[0] + ')', function (done) {
+                    run(2, function (error, result) {
+                        assert.strictEqual(result.length, 1);
+                        assert.strictEqual(result[0].row, 0);
+                        assert.strictEqual(result[0].col, 4);
+                        // accuracy sums differences of all rows, 4 / 3
+                        assert.ok(Math.abs(result[0].accuracy - 4 / 3) < 1e-6);
+                        
+                        run(3, function (error, result) {
+                            assert.strictEqual(result.length, 2);
+                            assert.strictEqual(result[0].col, 0);
+                            assert.strictEqual(result[0].accuracy, 3);
+                            done();
+                        });
+                    });
+                });
+            });
+        });
+    });
+    
+    describe('interleaved data', function () {
+        it('should match K buffer', function (done) {
+            search({
+                rows: 2, cols: 3, channels: 1,
+                data: new Buffer([ 255, 255, 200, 255, 255, 200 ])
+            }, {
+                rows: 2, cols: 1, channels: 1,
+                data: new Buffer([ 200, 200 ])
+            }, 0, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].row, 0);
+                assert.strictEqual(result[0].col, 2);
+                done();
+            });
+        });
+        
+        it('should match RGBA buffer against RGB template', function (done) {
+            search({
+                rows: 1, cols: 2, channels: 4,
+                data: new Buffer([ 255, 0, 0, 255, 0, 0, 255, 255 ])
+            }, {
+                rows: 1, cols: 1, channels: 3,
+                data: new Buffer([ 0, 0, 255 ])
+            }, 0, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].row, 0);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+        
+        it('should match interleaved image against planar template', function (done) {
+            search({
+                rows: 1, cols: 2, channels: 3,
+                data: new Float32Array([ 255, 0, 0, 0, 0, 255 ])
+            }, {
+                rows: 1, cols: 1, channels: 3,
+                data: [
+                    new Float32Array([ 0 ]),
+                    new Float32Array([ 0 ]),
+                    new Float32Array([ 255 ])
+                ]
+            }, 0, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+    });
+    
+    describe('8-bit data', function () {
+        it('should match planar Uint8Array channels', function (done) {
+            search({
+                rows: 2, cols: 2, channels: 3,
+                data: [
+                    new Uint8Array([ 255, 10, 255, 255 ]),
+                    new Uint8Array([ 255, 20, 255, 255 ]),
+                    new Uint8Array([ 255, 30, 255, 255 ])
+                ]
+            }, {
+                rows: 1, cols: 1, channels: 3,
+                data: [
+                    new Uint8Array([ 12 ]),
+                    new Uint8Array([ 20 ]),
+                    new Uint8Array([ 27 ])
+                ]
+            }, 5, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].row, 0);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+        
+        it('should not wrap around on differences of 8-bit samples', function (done) {
+            search({
+                rows: 1, cols: 2, channels: 1,
+                data: new Buffer([ 0, 255 ])
+            }, {
+                rows: 1, cols: 1, channels: 1,
+                data: new Buffer([ 250 ])
+            }, 5, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].col, 1);
+                done();
+            });
+        });
+        
+        it('should compute the same accuracy as float data', function (done) {
+            var img = [ 10, 20, 30, 40, 50, 60 ];
+            var tpl = [ 12, 18, 33 ];
+            
+            search({
+                rows: 2, cols: 3, channels: 1, data: new Buffer(img)
+            }, {
+                rows: 1, cols: 3, channels: 1, data: new Buffer(tpl)
+            }, 3, 0, function (error, bytes) {
+                search({
+                    rows: 2, cols: 3, channels: 1, data: [ new Float32Array(img) ]
+                }, {
+                    rows: 1, cols: 3, channels: 1, data: [ new Float32Array(tpl) ]
+                }, 3, 0, function (error, floats) {
+                    assert.strictEqual(bytes.length, 1);
+                    assert.strictEqual(floats.length, 1);
+                    assert.ok(Math.abs(bytes[0].accuracy - floats[0].accuracy) < 1e-5);
+                    done();
+                });
+            });
+        });
+    });
+    
+    describe('vector kernel', function () {
+        function makeRow(cols, channels, value) {
+            var data = new Buffer(cols * channels);
+            data.fill(value);
+            return data;
+        }
+        
+        it('should expose selected instruction set', function () {
+            assert.ok([ 'scalar', 'sse2', 'avx2', 'avx512bw' ].indexOf(isa) !== -1);
+        });
+        
+        it('should count misses on rows wider than vector registers (RGBA)', function (done) {
+            var img = makeRow(100, 4, 100);
+            var tpl = makeRow(90, 4, 100);
+            
+            // three pixels off by 10 in R and G, one of them at the row tail
+            [ 0, 40, 89 ].forEach(function (x) {
+                tpl[x * 4] = 105;
+                tpl[x * 4 + 1] = 95;
+            });
+            
+            search({
+                rows: 1, cols: 100, channels: 4, data: img
+            }, {
+                rows: 1, cols: 90, channels: 4, data: tpl
+            }, 9, 3, function (error, result) {
+                assert.strictEqual(result.length, 11);
+                
+                search({
+                    rows: 1, cols: 100, channels: 4, data: img
+                }, {
+                    rows: 1, cols: 90, channels: 4, data: tpl
+                }, 9, 2, function (error, result) {
+                    assert.strictEqual(result.length, 0);
+                    done();
+                });
+            });
+        });
+        
+        it('should ignore A channel on rows wider than vector registers', function (done) {
+            var img = makeRow(80, 4, 200);
+            var tpl = makeRow(80, 4, 200);
+            
+            for (var x = 0; x < 80; x++) {
+                tpl[x * 4 + 3] = 0;
+            }
+            
+            search({
+                rows: 1, cols: 80, channels: 4, data: img
+            }, {
+                rows: 1, cols: 80, channels: 4, data: tpl
+            }, 0, 0, function (error, result) {
+                assert.strictEqual(result.length, 1);
+                assert.strictEqual(result[0].accuracy, 0);
+                done();
+            });
+        });
+    });
+    
+    describe('stub column', function () {
+        var ROWS = 90, COLS = 100, TPL_ROWS = 70, TPL_COLS = 6;
+        
+        // template cut at (5, 10) is planted again at (15, 40) with three
+        // misses and at (18, 80) with four, random pixels elsewhere miss
+        // the stub column right away
+        function makeImage() {
+            var data = [];
+            var seed = 42;
+            
+            for (var i = 0; i < ROWS * COLS; i++) {
+                seed = (seed * 16807) % 2147483647;
+                data.push(seed % 256);
+            }
+            
+            function plant(row, col, misses) {
+                for (var y = 0; y < TPL_ROWS; y++) {
+                    for (var x = 0; x < TPL_COLS; x++) {
+                        data[(row + y) * COLS + col + x] = data[(5 + y) * COLS + 10 + x];
+                    }
+                }
+                misses.forEach(function (m) {
+                    var i = (row + m[0]) * COLS + col + m[1];
+                    data[i] = (data[i] + 100) % 256;
+                });
+            }
+            
+            plant(15, 40, [ [ 10, 0 ], [ 30, 2 ], [ 50, 5 ] ]);
+            plant(18, 80, [ [ 1, 1 ], [ 20, 3 ], [ 40, 4 ], [ 69, 0 ] ]);
+            
+            return data;
+        }
+        
+        // masked template has transparent rows 2 to 4 of garbage, which
+        // leaves opaque runs longer than 64 rows
+        function makeTemplate(img, masked) {
+            var k = [], a = [];
+            
+            for (var y = 0; y < TPL_ROWS; y++) {
+                for (var x = 0; x < TPL_COLS; x++) {
+                    var transparent = masked && y >= 2 && y <= 4;
+                    var v = img[(5 + y) * COLS + 10 + x];
+                    k.push(transparent ? (v + 100) % 256 : v);
+                    a.push(transparent ? 0 : 255);
+                }
+            }
+            
+            return { k: k, a: a };
+        }
+        
+        function scan(img, tpl, colorTolerance, pixelTolerance) {
+            var result = [];
+            
+            for (var r = 0; r + TPL_ROWS <= ROWS; r++) {
+                for (var c = 0; c + TPL_COLS <= COLS; c++) {
+                    var miss = 0, sum = 0, max = 0;
+                    
+                    for (var i = 0; i < TPL_ROWS * TPL_COLS && miss <= pixelTolerance; i++) {
+                        if (tpl.a[i] === 0) {
+                            continue;
+                        }
+                        var d = Math.abs(img[(r + Math.floor(i / TPL_COLS)) * COLS + c + i % TPL_COLS] - tpl.k[i]);
+                        miss += (d > colorTolerance) ? 1 : 0;
+                        sum += d;
+                        max = Math.max(max, d);
+                    }
+                    
+                    if (miss <= pixelTolerance) {
+                        result.push({ row: r, col: c, accuracy: (max > 0) ? sum / max : 0 });
+                    }
+                }
+            }
+            
+            return result;
+        }
+        
+        function interleave(k, a) {
+            var data = new Buffer(k.length * 2);
+            for (var i = 0; i < k.length; i++) {
+                data[i * 2] = k[i];
+                data[i * 2 + 1] = a[i];
+            }
+            return data;
+        }
+        
+        [
+            [ '8-bit', function (img) {
+                return { rows: ROWS, cols: COLS, channels: 1, data: new Buffer(img) };
+            }, function (tpl) {
+                return { rows: TPL_ROWS, cols: TPL_COLS, channels: 2, data: interleave(tpl.k, tpl.a) };
+            } ],
+            [ 'float', function (img) {
+                return { rows: ROWS, cols: COLS, channels: 1, data: [ new Float32Array(img) ] };
+            }, function (tpl) {
+                return { rows: TPL_ROWS, cols: TPL_COLS, channels: 2, data: [ new Float32Array(tpl.k), new Float32Array(tpl.a) ] };
+            } ]
+        ].forEach(function (type) {
+            [ false, true ].forEach(function (masked) {
+                var title = type[0] + (masked ? ', masked' : '');
+                
+                it('should match a plain scan on templates taller than vector registers (' + title + ')', function (done) {
+                    var img = makeImage();
+                    var tpl = makeTemplate(img, masked);
+                    var expected = scan(img, tpl, 20, 3);
+                    
+                    search(type[1](img), type[2](tpl), 20, 3, { mask: masked }, function (error, result) {
+                        assert.deepEqual(expected.map(function (m) { return [ m.row, m.col ]; }), [ [ 5, 10 ], [ 15, 40 ] ]);
+                        assert.strictEqual(result.length, expected.length);
+                        
+                        result.forEach(function (m, i) {
+                            assert.strictEqual(m.row, expected[i].row);
+                            assert.strictEqual(m.col, expected[i].col);
+                            assert.ok(Math.abs(m.accuracy - expected[i].accuracy) < 1e-4);
+                        });
+                        
+                        done();
+                    });
+                });
+            });
+        });
+    });
+    
+    describe('threads', function () {
+        it('should return the same matches as a single thread', function (done) {
+            var img = new Buffer(64 * 48);
+            var tpl = new Buffer(4 * 3);
+            
+            for (var i = 0; i < img.length; i++) {
+                img[i] = (i * 7) % 5 * 50;
+            }
+            tpl.fill(0);
+            
+            search({
+                rows: 48, cols: 64, channels: 1, data: img
+            }, {
+                rows: 3, cols: 4, channels: 1, data: tpl
+            }, 100, 6, function (error, single) {
+                search({
+                    rows: 48, cols: 64, channels: 1, data: img
+                }, {
+                    rows: 3, cols: 4, channels: 1, data: tpl
+                }, 100, 6, { threads: 4 }, function (error, multiple) {
+                    assert.ok(single.length > 0);
+                    assert.deepEqual(multiple, single);
+                    done();
+                });
+            });
+        });
+        
+        it('should return the same matches from concurrent searches sharing the pool', function (done) {
+            var size = require('../build/Release/search').setPoolSize();
+            var count = size * 2 + 2;
+            var img = new Buffer(160 * 120);
+            var pending = count * 2;
+            var single = [];
+            var multiple = [];
+            var seed = 7;
+            
+            for (var i = 0; i < img.length; i++) {
+                seed = (seed * 16807) % 2147483647;
+                img[i] = seed % 4 * 60;
+            }
+            
+            // each search looks for its own patch of the image
+            function run(n, threads, results) {
+                var tpl = new Buffer(4 * 3);
+                var start = (n * 7 % 117) * 160 + n * 11 % 156;
+                for (var y = 0; y < 3; y++) {
+                    img.copy(tpl, y * 4, start + y * 160, start + y * 160 + 4);
+                }
+                
+                search({
+                    rows: 120, cols: 160, channels: 1, data: img
+                }, {
+                    rows: 3, cols: 4, channels: 1, data: tpl
+                }, 0, 3, { threads: threads }, function (error, result) {
+                    results[n] = result;
+                    
+                    if (--pending === 0) {
+                        for (var k = 0; k < count; k++) {
+                            assert.ok(single[k].length > 0);
+                            assert.deepEqual(multiple[k], single[k]);
+                        }
+                        done();
+                    }
+                });
+            }
+            
+            for (var n = 0; n < count; n++) {
+                run(n, 1, single);
+                run(n, size + 1, multiple);
+            }
+        });
+    });
+    
+    describe('prefilter', function () {
+        // copies sit right at the color and pixel tolerance limits or one
+        // step past them, a bound looser than the search drops or keeps one
+        var img = fixtures.makeNoise(120, 80, 3);
+        var tpl = fixtures.crop(img, 120, 5, 4, 16, 12);
+        
+        fixtures.plant(img, 120, tpl, 16, 30, 6, 10, 0);
+        fixtures.plant(img, 120, tpl, 16, 55, 30, 10, 2);
+        fixtures.plant(img, 120, tpl, 16, 85, 8, 0, 2);
+        fixtures.plant(img, 120, tpl, 16, 10, 50, 10, 3);
+        fixtures.plant(img, 120, tpl, 16, 50, 60, 11, 0);
+        fixtures.plant(img, 120, tpl, 16, 95, 55, 0, 3);
+        
+        [ 1, 2, 3 ].forEach(function (levels) {
+            it('should return the same matches with ' + levels + ' level(s)', function (done) {
+                search({
+                    rows: 80, cols: 120, channels: 3, data: img
+                }, {
+                    rows: 12, cols: 16, channels: 3, data: tpl
+                }, 30, 2, function (error, plain) {
+                    search({
+                        rows: 80, cols: 120, channels: 3, data: img
+                    }, {
+                        rows: 12, cols: 16, channels: 3, data: tpl
+                    }, 30, 2, { prefilter: levels }, function (error, filtered) {
+                        assert.deepEqual(filtered, plain);
+                        assert.deepEqual(fixtures.positions(filtered), [ [ 4, 5 ], [ 6, 30 ], [ 8, 85 ], [ 30, 55 ] ]);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+    
+    describe('pyramid', function () {
+        // copies sit at odd rows and columns, off the grid of every level,
+        // at and past the tolerance limits
+        var img = fixtures.makeNoise(160, 120, 5);
+        var tpl = fixtures.crop(img, 160, 15, 7, 32, 24);
+        
+        fixtures.plant(img, 160, tpl, 32, 63, 41, 10, 2);
+        fixtures.plant(img, 160, tpl, 32, 113, 73, 0, 2);
+        fixtures.plant(img, 160, tpl, 32, 21, 89, 10, 0);
+        fixtures.plant(img, 160, tpl, 32, 71, 85, 10, 3);
+        
+        [ 2, 3, 4 ].forEach(function (levels) {
+            it('should return the same matches with ' + levels + ' level(s)', function (done) {
+                search({
+                    rows: 120, cols: 160, channels: 3, data: img
+                }, {
+                    rows: 24, cols: 32, channels: 3, data: tpl
+                }, 30, 2, function (error, plain) {
+                    search({
+                        rows: 120, cols: 160, channels: 3, data: img
+                    }, {
+                        rows: 24, cols: 32, channels: 3, data: tpl
+                    }, 30, 2, { pyramid: levels }, function (error, coarse) {
+                        assert.deepEqual(coarse, plain);
+                        assert.deepEqual(fixtures.positions(coarse), [ [ 7, 15 ], [ 41, 63 ], [ 73, 113 ], [ 89, 21 ] ]);
+                        done();
+                    });
+                });
+            });
+        });
+    });
+    
+    describe('fft', function () {
+        // copies with bad pixels up to and past the pixel tolerance, each
+        // bad pixel adds the most it can to the sum of squared differences
+        var img = fixtures.makeNoise(120, 80, 11);
+        var tpl = fixtures.crop(img, 120, 5, 4, 16, 12);
+        
+        fixtures.plant(img, 120, tpl, 16, 30, 6, 0, 6);
+        fixtures.plant(img, 120, tpl, 16, 55, 30, 10, 6);
+        fixtures.plant(img, 120, tpl, 16, 85, 8, 0, 7);
+        fixtures.plant(img, 120, tpl, 16, 10, 50, 10, 5);
+        
+        it('should return the same matches', function (done) {
+            search({
+                rows: 80, cols: 120, channels: 3, data: img
+            }, {
+                rows: 12, cols: 16, channels: 3, data: tpl
+            }, 30, 6, function (error, plain) {
+                search({
+                    rows: 80, cols: 120, channels: 3, data: img
+                }, {
+                    rows: 12, cols: 16, channels: 3, data: tpl
+                }, 30, 6, { fft: true }, function (error, filtered) {
+                    assert.deepEqual(filtered, plain);
+                    assert.deepEqual(fixtures.positions(filtered), [ [ 4, 5 ], [ 6, 30 ], [ 30, 55 ], [ 50, 10 ] ]);
+                    done();
+                });
+            });
+        });
+    });
+    
+    describe('focus', function () {
+        it('should return the most accurate of overlaping matches', function (done) {
+            var img = new Buffer([ 9, 1, 2, 9, 1, 0, 1, 2, 2, 1, 0, 1, 9, 2, 1, 9 ]);
+            var tpl = new Buffer([ 0, 1, 1, 0 ]);
+            
+            search({
+                rows: 4, cols: 4, channels: 1, data: img
+            }, {
+                rows: 2, cols: 2, channels: 1, data: tpl
+            }, 255, 0, { focus: true }, function (error, result) {
+                assert.deepEqual(result, [{ row: 1, col: 1, accuracy: 0 }]);
+                done();
+            });
+        });
+        
+        it('should keep the middle of five overlapping matches', function (done) {
+            // matches (0, 0, 2), (0, 2, 1), (1, 1, 0), (2, 0, 1) and (2, 2, 2)
+            var img = new Buffer([ 1, 8, 2, 9, 9, 0, 9, 0, 0, 9, 0, 8, 9, 1, 8, 0 ]);
+            var tpl = new Buffer([ 0, 9, 9, 0 ]);
+            
+            search({
+                rows: 4, cols: 4, channels: 1, data: img
+            }, {
+                rows: 2, cols: 2, channels: 1, data: tpl
+            }, 2, 0, function (error, result) {
+                assert.deepEqual(result, [
+                    { row: 0, col: 0, accuracy: 2 },
+                    { row: 0, col: 2, accuracy: 1 },
+                    { row: 1, col: 1, accuracy: 0 },
+                    { row: 2, col: 0, accuracy: 1 },
+                    { row: 2, col: 2, accuracy: 2 }
+                ]);
+                
+                search({
+                    rows: 4, cols: 4, channels: 1, data: img
+                }, {
+                    rows: 2, cols: 2, channels: 1, data: tpl
+                }, 2, 0, { focus: true }, function (error, result) {
+                    assert.deepEqual(result, [{ row: 1, col: 1, accuracy: 0 }]);
+                    done();
+                });
+            });
+        });
+        
+        it('should sort matches by accuracy', function (done) {
+            var img = new Buffer([ 5, 1, 9, 9, 0, 1 ]);
+            var tpl = new Buffer([ 0, 1 ]);
+            
+            search({
+                rows: 1, cols: 6, channels: 1, data: img
+            }, {
+                rows: 1, cols: 2, channels: 1, data: tpl
+            }, 255, 0, { focus: true }, function (error, result) {
+                assert.deepEqual(result, [
+                    { row: 0, col: 4, accuracy: 0 },
+                    { row: 0, col: 0, accuracy: 1 }
+                ]);
+                done();
+            });
+        });
+        
+        it('should return all matches by default', function (done) {
+            var img = new Buffer([ 5, 1, 9, 9, 0, 1 ]);
+            var tpl = new Buffer([ 0, 1 ]);
+            
+            search({
+                rows: 1, cols: 6, channels: 1, data: img
+            }, {
+                rows: 1, cols: 2, channels: 1, data: tpl
+            }, 255, 0, function (error, result) {
+                assert.strictEqual(result.length, 5);
+                done();
+            });
+        });
+    });
+    
+    describe('maxResults', function () {
+        it('should return the most accurate matches', function (done) {
+            var img = new Buffer([ 5, 1, 9, 9, 0, 1 ]);
+            var tpl = new Buffer([ 0, 1 ]);
+            
+            search({
+                rows: 1, cols: 6, channels: 1, data: img
+            }, {
+                rows: 1, cols: 2, channels: 1, data: tpl
+            }, 255, 0, { maxResults: 2 }, function (error, result) {
+                assert.deepEqual(result, [
+                    { row: 0, col: 4, accuracy: 0 },
+                    { row: 0, col: 0, accuracy: 1 }
+                ]);
+                done();
+            });
+        });
+    });
+    
+    describe('packed', function () {
+        it('should pass matches as typed arrays', function (done) {
+            search({
+                rows: 2, cols: 3, channels: 1, data: new Buffer([ 0, 1, 0, 2, 1, 0 ])
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 1 ])
+            }, 0, 0, { packed: true }, function (error, result) {
+                assert.strictEqual(error, null);
+                assert.strictEqual(result.length, 2);
+                assert.ok(result.positions instanceof Int32Array);
+                assert.ok(result.accuracy instanceof Float32Array);
+                assert.deepEqual(Array.prototype.slice.call(result.positions), [ 1, 0, 1, 1 ]);
+                assert.deepEqual(Array.prototype.slice.call(result.accuracy), [ 0, 0 ]);
+                done();
+            });
+        });
+        
+        it('should pass empty arrays without matches', function (done) {
+            search({
+                rows: 1, cols: 2, channels: 1, data: new Buffer([ 0, 0 ])
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 9 ])
+            }, 0, 0, { packed: true }, function (error, result) {
+                assert.strictEqual(result.length, 0);
+                assert.strictEqual(result.positions.length, 0);
+                assert.strictEqual(result.accuracy.length, 0);
+                done();
+            });
+        });
+    });
+    
+    describe('stats', function () {
+        it('should count candidates by how far they got', function (done) {
+            search({
+                rows: 2, cols: 4, channels: 1, data: new Buffer([ 1, 2, 9, 1, 2, 9, 1, 2 ])
+            }, {
+                rows: 1, cols: 2, channels: 1, data: new Buffer([ 1, 2 ])
+            }, 0, 0, { stats: true }, function (error, result, stats) {
+                assert.strictEqual(result.length, 2);
+                assert.strictEqual(stats.candidates, 6);
+                assert.strictEqual(stats.filtered, 0);
+                assert.strictEqual(stats.stubRejected + stats.verified, 6);
+                assert.strictEqual(stats.matches, 2);
+                assert.ok(stats.verified >= 2);
+                assert.strictEqual(stats.stub.channel, 'k');
+                assert.ok(stats.stub.column === 0 || stats.stub.column === 1);
+                
+                [ 'unwrap', 'prepare', 'scan', 'focus', 'marshal' ].forEach(function (phase) {
+                    assert.strictEqual(typeof stats.times[phase], 'number');
+                });
+                
+                done();
+            });
+        });
+        
+        it('should pass no stats unless asked for', function (done) {
+            search({
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 1 ])
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 1 ])
+            }, 0, 0, function (error, result, stats) {
+                assert.strictEqual(arguments.length, 2);
+                done();
+            });
+        });
+    });
+    
+    describe('onMatches', function () {
+        var img = new Buffer([
+            1, 0, 0, 1,
+            0, 0, 0, 0,
+            0, 1, 0, 1
+        ]);
+        
+        it('should stream every match before calling back', function (done) {
+            var streamed = [];
+            
+            search({
+                rows: 3, cols: 4, channels: 1, data: img
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 1 ])
+            }, 0, 0, {
+                onMatches: function (matches) {
+                    streamed = streamed.concat(matches);
+                }
+            }, function (error, result) {
+                assert.strictEqual(error, null);
+                assert.deepEqual(streamed, result);
+                assert.strictEqual(streamed.length, 4);
+                done();
+            });
+        });
+        
+        it('should cancel search when returning false', function (done) {
+            var calls = 0;
+            var big = new Buffer(1500 * 1000);
+            
+            search({
+                rows: 1000, cols: 1500, channels: 1, data: big
+            }, {
+                rows: 10, cols: 10, channels: 1, data: new Buffer(100)
+            }, 0, 0, {
+                onMatches: function () {
+                    calls++;
+                    return false;
+                }
+            }, function (error, result) {
+                assert.strictEqual(error.code, 'ECANCELED');
+                assert.ok(calls >= 1);
+                assert.ok(result.length < 1491 * 991);
+                done();
+            });
+        });
+    });
+    
+    describe('cancel', function () {
+        var img = new Buffer(1500 * 1000);
+        var tpl = new Buffer(40 * 40);
+        
+        for (var i = 0; i < img.length; i++) {
+            img[i] = (i * 7 + (i >> 9)) % 256;
+        }
+        
+        it('should report cancelled search', function (done) {
+            var handle = search({
+                rows: 1000, cols: 1500, channels: 1, data: img
+            }, {
+                rows: 40, cols: 40, channels: 1, data: tpl
+            }, 255, 0, function (error, result) {
+                assert.strictEqual(error.code, 'ECANCELED');
+                assert.ok(result.length < (1500 - 39) * (1000 - 39));
+                done();
+            });
+            
+            handle.cancel();
+        });
+        
+        it('should report search out of time', function (done) {
+            search({
+                rows: 1000, cols: 1500, channels: 1, data: img
+            }, {
+                rows: 40, cols: 40, channels: 1, data: tpl
+            }, 255, 0, { deadlineMs: 1 }, function (error, result) {
+                assert.strictEqual(error.code, 'ETIMEDOUT');
+                done();
+            });
+        });
+        
+        it('should ignore cancel of finished search', function (done) {
+            var handle = search({
+                rows: 1, cols: 2, channels: 1, data: new Buffer([ 0, 1 ])
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer([ 1 ])
+            }, 0, 0, function (error, result) {
+                assert.strictEqual(error, null);
+                assert.deepEqual(result, [{ row: 0, col: 1, accuracy: 0 }]);
+                
+                handle.cancel();
+                done();
+            });
+        });
+    });
+    
+    describe('setPoolSize', function () {
+        var setPoolSize = require('../build/Release/search').setPoolSize;
+        
+        it('should return pool size', function () {
+            assert.ok(setPoolSize() >= 1);
+        });
+        
+        it('should throw error if "size" is 0', function () {
+            assert.throws(function () {
+                setPoolSize(0);
+            }, /Bad argument 'size'/);
+        });
+        
+        it('should not resize started pool', function () {
+            var size = setPoolSize();
+            
+            assert.strictEqual(setPoolSize(size), size);
+            assert.throws(function () {
+                setPoolSize(size + 1);
+            }, /Search pool already started/);
+        });
+    });
+    
+    describe('getMetrics', function () {
+        var getMetrics = require('../build/Release/search').getMetrics;
+        
+        function value(text, name) {
+            var match = new RegExp('^' + name + ' (\\S+)$', 'm').exec(text);
+            return match ? Number(match[1]) : NaN;
+        }
+        
+        it('should count searches and pixels', function (done) {
+            var before = getMetrics();
+            
+            search({
+                rows: 2, cols: 3, channels: 1, data: new Buffer(6)
+            }, {
+                rows: 1, cols: 1, channels: 1, data: new Buffer(1)
+            }, 255, 0, function () {
+                var after = getMetrics();
+                
+                [ 'imagesearch_searches_started_total', 'imagesearch_searches_completed_total' ].forEach(function (name) {
+                    assert.strictEqual(value(after, name), value(before, name) + 1);
+                });
+                
+                assert.strictEqual(value(after, 'imagesearch_pixels_scanned_total'), value(before, 'imagesearch_pixels_scanned_total') + 6);
+                assert.strictEqual(value(after, 'imagesearch_worker_busy_seconds_count'), value(before, 'imagesearch_worker_busy_seconds_count') + 1);
+                assert.ok(/imagesearch_queue_wait_seconds_bucket\{le="\+Inf"\} \d+/.test(after));
+                done();
+            });
+        });
+        
+        it('should count only pixels scanned by cancelled searches', function (done) {
+            var before = getMetrics();
+            
+            var handle = search({
+                rows: 1000, cols: 1500, channels: 1, data: new Buffer(1500 * 1000)
+            }, {
+                rows: 40, cols: 40, channels: 1, data: new Buffer(40 * 40)
+            }, 255, 0, function (error) {
+                var after = getMetrics();
+                
+                assert.strictEqual(error.code, 'ECANCELED');
+                assert.strictEqual(value(after, 'imagesearch_searches_cancelled_total'), value(before, 'imagesearch_searches_cancelled_total') + 1);
+                assert.ok(value(after, 'imagesearch_pixels_scanned_total') - value(before, 'imagesearch_pixels_scanned_total') < (1500 - 39) * (1000 - 39));
+                assert.strictEqual(value(after, 'imagesearch_worker_busy_seconds_count'), value(before, 'imagesearch_worker_busy_seconds_count') + 1);
+                done();
+            });
+            
+            handle.cancel();
+        });
+    });
+    
+    describe('batch', function () {
+        var img = new Buffer([ 5, 1, 9, 9, 0, 1 ]);
+        var tpl = new Buffer([ 0, 1 ]);
+        
+        [ { batch: 3 }, { batch: 8 }, { batch: 8, batchWindow: 5 } ].forEach(function (options) {
+            it('should call back every search with ' + JSON.stringify(options), function (done) {
+                var order = [];
+                
+                for (var i = 0; i < 5; i++) {
+                    search({
+                        rows: 1, cols: 6, channels: 1, data: img
+                    }, {
+                        rows: 1, cols: 2, channels: 1, data: tpl
+                    }, i % 2 ? 4 : 255, 0, options, function (i, error, result) {
+                        assert.deepEqual(result[0], i % 2 ? { row: 0, col: 4, accuracy: 0 } : { row: 0, col: 0, accuracy: 1 });
+                        order.push(i);
+                        
+                        if (order.length === 5) {
+                            assert.deepEqual(order, [ 0, 1, 2, 3, 4 ]);
+                            done();
+                        }
+                    }.bind(null, i));
+                }
+            });
+        });
+    });
+    
+    describe('firstMatch', function () {
+        it('should return the first match only', function (done) {
+            var img = new Buffer([ 5, 1, 9, 9, 0, 1 ]);
+            var tpl = new Buffer([ 0, 1 ]);
+            
+            search({
+                rows: 1, cols: 6, channels: 1, data: img
+            }, {
+                rows: 1, cols: 2, channels: 1, data: tpl
+            }, 255, 0, { firstMatch: true, threads: 4 }, function (error, result) {
+                assert.deepEqual(result, [{ row: 0, col: 0, accuracy: 1 }]);
+                done();
+            });
+        });
     });
 });
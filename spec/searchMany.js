@@ -0,0 +1,106 @@
+var binding = require('../build/Release/search');
+var search = binding.search;
+var searchMany = binding.searchMany;
+var Template = binding.Template;
+var assert = require('assert');
+var fixtures = require('./fixtures');
+
+describe('searchMany(imgMatrix, tplMatrices, colorTolerance, pixelTolerance, options, callback)', function () {
+    var image = { rows: 60, cols: 80, channels: 3, data: fixtures.makeImage(80, 60) };
+    var templates = [
+        { rows: 24, cols: 32, channels: 3, data: fixtures.crop(image.data, 80, 21, 13, 32, 24) },
+        { rows: 8, cols: 5, channels: 3, data: fixtures.crop(image.data, 80, 70, 40, 5, 8) },
+        { rows: 61, cols: 10, channels: 3, data: new Buffer(61 * 10 * 3) },
+        { rows: 16, cols: 16, channels: 3, data: fixtures.crop(image.data, 80, 2, 44, 16, 16) }
+    ];
+    
+    function searchEach(options, callback) {
+        var results = [];
+        var pending = templates.length;
+        
+        templates.forEach(function (template, index) {
+            search(image, template, 30, 2, options, function (error, result) {
+                results[index] = result;
+                
+                if ( ! --pending) {
+                    callback([].concat.apply([], results.map(function (result, index) {
+                        return result.map(function (match) {
+                            match.template = index;
+                            return match;
+                        });
+                    })));
+                }
+            });
+        });
+    }
+    
+    it('should throw error if "tplMatrices" is not array', function () {
+        assert.throws(function () {
+            searchMany(image, templates[0], 0, 0);
+        }, /Bad argument 'tplMatrices'/);
+    });
+    
+    it('should throw error if any template is bad', function () {
+        assert.throws(function () {
+            searchMany(image, [ templates[0], { rows: 1, cols: 1, channels: 3 } ], 0, 0);
+        }, /Bad argument 'tplMatrix'/);
+    });
+    
+    it('should return no matches for no templates', function (done) {
+        searchMany(image, [], 0, 0, function (error, result) {
+            assert.deepEqual(result, []);
+            done();
+        });
+    });
+    
+    [
+        {},
+        { threads: 4 },
+        { prefilter: 2 },
+        { fft: true },
+        { pyramid: 2 },
+        { focus: true },
+        { maxResults: 1 },
+        { firstMatch: true, threads: 3 }
+    ].forEach(function (options) {
+        it('should return the same matches as separate searches with ' + JSON.stringify(options), function (done) {
+            searchEach(options, function (expected) {
+                searchMany(image, templates, 30, 2, options, function (error, result) {
+                    assert.deepEqual(result, expected);
+                    assert.ok(result.length >= 3);
+                    done();
+                });
+            });
+        });
+    });
+    
+    it('should take prepared templates', function (done) {
+        var prepared = templates.map(function (template) {
+            return new Template(template);
+        });
+        
+        searchEach({}, function (expected) {
+            searchMany(image, prepared, 30, 2, function (error, result) {
+                assert.deepEqual(result, expected);
+                done();
+            });
+        });
+    });
+    
+    it('should pass packed matches with template indexes', function (done) {
+        searchMany({
+            rows: 1, cols: 3, channels: 1, data: new Buffer([ 5, 1, 2 ])
+        }, [{
+            rows: 1, cols: 1, channels: 1, data: new Buffer([ 2 ])
+        }, {
+            rows: 1, cols: 1, channels: 1, data: new Buffer([ 7 ])
+        }, {
+            rows: 1, cols: 1, channels: 1, data: new Buffer([ 5 ])
+        }], 0, 0, { packed: true }, function (error, result) {
+            assert.strictEqual(result.length, 2);
+            assert.deepEqual(Array.prototype.slice.call(result.positions), [ 2, 0, 0, 0 ]);
+            assert.deepEqual(Array.prototype.slice.call(result.templates), [ 0, 2 ]);
+            done();
+        });
+    });
+});
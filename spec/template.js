@@ -0,0 +1,106 @@
+var binding = require('../build/Release/search');
+var search = binding.search;
+var Template = binding.Template;
+var assert = require('assert');
+var fixtures = require('./fixtures');
+
+describe('Template(matrix)', function () {
+    var img = fixtures.makeImage(80, 60);
+    var tpl = fixtures.crop(img, 80, 21, 13, 32, 24);
+    
+    tpl[0] = 0;
+    tpl[100] = 255;
+    
+    it('should throw error if "matrix" is not object', function () {
+        assert.throws(function () {
+            new Template();
+        }, /Bad argument 'matrix'/);
+    });
+    
+    it('should throw error if "matrix" is empty', function () {
+        assert.throws(function () {
+            new Template({ rows: 0, cols: 0, channels: 1, data: new Buffer(1) });
+        }, /Bad argument 'matrix'/);
+    });
+    
+    it('should throw error if "matrix.data" is too short', function () {
+        assert.throws(function () {
+            new Template({ rows: 2, cols: 2, channels: 3, data: new Buffer(3) });
+        }, /Bad argument 'matrix.data'/);
+    });
+    
+    it('should expose matrix dimensions', function () {
+        var prepared = new Template({ rows: 24, cols: 32, channels: 3, data: tpl });
+        
+        assert.strictEqual(prepared.rows, 24);
+        assert.strictEqual(prepared.cols, 32);
+        assert.strictEqual(prepared.channels, 3);
+    });
+    
+    it('should be constructed without "new"', function () {
+        assert.ok(Template({ rows: 24, cols: 32, channels: 3, data: tpl }) instanceof Template);
+    });
+    
+    [ 'interleaved', 'planar' ].forEach(function (layout) {
+        it('should return the same matches as ' + layout + ' template data', function (done) {
+            var data = layout === 'planar' ? fixtures.split(tpl, 3) : tpl;
+            var prepared = new Template({ rows: 24, cols: 32, channels: 3, data: data });
+            
+            search({
+                rows: 60, cols: 80, channels: 3, data: img
+            }, {
+                rows: 24, cols: 32, channels: 3, data: data
+            }, 30, 2, function (error, plain) {
+                search({
+                    rows: 60, cols: 80, channels: 3, data: img
+                }, prepared, 30, 2, function (error, result) {
+                    assert.deepEqual(result, plain);
+                    assert.strictEqual(result[0].row, 13);
+                    assert.strictEqual(result[0].col, 21);
+                    done();
+                });
+            });
+        });
+    });
+    
+    it('should not depend on source data once constructed', function (done) {
+        var data = new Buffer(tpl);
+        var prepared = new Template({ rows: 24, cols: 32, channels: 3, data: data });
+        
+        data.fill(0);
+        
+        search({
+            rows: 60, cols: 80, channels: 3, data: img
+        }, prepared, 30, 2, function (error, result) {
+            assert.strictEqual(result[0].row, 13);
+            assert.strictEqual(result[0].col, 21);
+            done();
+        });
+    });
+    
+    it('should be reused across pyramid searches', function (done) {
+        var prepared = new Template({ rows: 24, cols: 32, channels: 3, data: tpl });
+        var pending = 3;
+        
+        for (var i = 0; i < 3; i++) {
+            search({
+                rows: 60, cols: 80, channels: 3, data: img
+            }, prepared, 30, 2, { pyramid: 3 }, function (error, result) {
+                assert.strictEqual(result[0].row, 13);
+                assert.strictEqual(result[0].col, 21);
+                
+                if ( ! --pending) {
+                    done();
+                }
+            });
+        }
+    });
+    
+    it('should throw error if data types differ', function () {
+        var prepared = new Template({ rows: 24, cols: 32, channels: 3, data: tpl });
+        
+        assert.throws(function () {
+            search({ rows: 60, cols: 80, channels: 3, data: new Float32Array(80 * 60 * 3) }, prepared, 0, 0);
+        }, /Data type mismatch/);
+    });
+});
@@ -251,6 +251,29 @@ describe('arguments validation', function () {
         });
     });
     
+    describe('interleaved "matrix.data"', function () {
+        it('should throw error if "imgMatrix.data" buffer is too short', function () {
+            testError(/Bad argument 'imgMatrix.data'/,
+                { rows: 2, cols: 2, data: new Buffer(11), channels: 3 },
+                { rows: 1, cols: 1, data: new Buffer(3), channels: 3 }
+            );
+        });
+        
+        it('should throw error if "tplMatrix.data" buffer is too short', function () {
+            testError(/Bad argument 'tplMatrix.data'/,
+                { rows: 2, cols: 2, data: new Buffer(12), channels: 3 },
+                { rows: 1, cols: 1, data: new Buffer(2), channels: 3 }
+            );
+        });
+        
+        it('should throw error if "imgMatrix.data" and "tplMatrix.data" types differ', function () {
+            testError(/Data type mismatch/,
+                { rows: 1, cols: 1, data: new Buffer(1), channels: 1 },
+                { rows: 1, cols: 1, data: [ new Float32Array(1) ], channels: 1 }
+            );
+        });
+    });
+    
     describe('rest arguments', function () {
         var img = {
             rows: 2, cols: 2, channels: 1,
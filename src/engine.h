@@ -0,0 +1,1966 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <vector>
+
+#include <Eigen/Dense>
+#include <unsupported/Eigen/FFT>
+
+#include "kernel.h"
+#include "pool.h"
+
+typedef Eigen::Stride<Eigen::Dynamic, Eigen::Dynamic> ChannelStride;
+
+template <typename T>
+struct Matrix {
+    typedef Eigen::Matrix<T, Eigen::Dynamic, Eigen::Dynamic, Eigen::RowMajor> Plain;
+    typedef Eigen::Map<const Plain, Eigen::Unaligned, ChannelStride> Channel;
+    
+    unsigned int rows;
+    unsigned int cols;
+    unsigned int channels;
+    Channel k;
+    Channel r;
+    Channel g;
+    Channel b;
+    Channel a;
+    
+    // maps channel samples in place, `stride` is the distance between
+    // two horizontally adjacent samples: 1 for planar, channels for interleaved,
+    // `pitch` between vertically adjacent ones when rows are padded
+    static Channel map(const T *data, unsigned int rows, unsigned int cols, unsigned int stride, unsigned int pitch = 0) {
+        return Channel(data, rows, cols, ChannelStride(pitch ? pitch : cols * stride, stride));
+    }
+    
+    // address of the sample at (row, col) of a channel
+    static const T *at(const Channel &channel, unsigned int row, unsigned int col) {
+        return channel.data() + row * channel.outerStride() + col * channel.innerStride();
+    }
+};
+
+typedef struct {
+    unsigned int row;
+    unsigned int col;
+    double accuracy;
+} Match;
+
+typedef enum {
+    STOP_NONE,
+    STOP_CANCELLED,
+    STOP_DEADLINE
+} StopReason;
+
+// Request to stop a search early, by cancellation from any thread or by a
+// deadline. Scans poll it once per candidate row and count the positions
+// they went through, so a search cut short tells how far it got.
+class Stop {
+public:
+    Stop() : reason(STOP_NONE), deadline(0), cut(false), positions(0) {
+        uv_mutex_init(&mutex);
+    }
+    
+    ~Stop() {
+        uv_mutex_destroy(&mutex);
+    }
+    
+    void cancel() {
+        uv_mutex_lock(&mutex);
+        if (reason == STOP_NONE) {
+            reason = STOP_CANCELLED;
+        }
+        uv_mutex_unlock(&mutex);
+    }
+    
+    // `at` in uv_hrtime() nanoseconds, 0 for none
+    void setDeadline(uint64_t at) {
+        uv_mutex_lock(&mutex);
+        deadline = at;
+        uv_mutex_unlock(&mutex);
+    }
+    
+    // true if scanning should stop, which marks the search as cut short
+    bool check() {
+        uv_mutex_lock(&mutex);
+        if (reason == STOP_NONE && deadline > 0 && uv_hrtime() >= deadline) {
+            reason = STOP_DEADLINE;
+        }
+        
+        const bool stop = reason != STOP_NONE;
+        cut = cut || stop;
+        uv_mutex_unlock(&mutex);
+        
+        return stop;
+    }
+    
+    // why the search was cut short, STOP_NONE if it ran to the end
+    StopReason stopped() {
+        uv_mutex_lock(&mutex);
+        const StopReason out = cut ? reason : STOP_NONE;
+        uv_mutex_unlock(&mutex);
+        
+        return out;
+    }
+    
+    void advance(uint64_t scanned) {
+        uv_mutex_lock(&mutex);
+        positions += scanned;
+        uv_mutex_unlock(&mutex);
+    }
+    
+    // candidate positions scanned so far, at every pyramid level
+    uint64_t scanned() {
+        uv_mutex_lock(&mutex);
+        const uint64_t out = positions;
+        uv_mutex_unlock(&mutex);
+        
+        return out;
+    }
+
+private:
+    StopReason reason;
+    uint64_t deadline;
+    bool cut;
+    uint64_t positions;
+    uv_mutex_t mutex;
+    
+    Stop(const Stop &);
+    Stop &operator=(const Stop &);
+};
+
+// Candidates of a scanned range by how far they got
+typedef struct {
+    uint64_t candidates;
+    // rejected by FFT or window sums
+    uint64_t filtered;
+    // rejected by the stub column
+    uint64_t stubRejected;
+    // compared in full
+    uint64_t verified;
+    uint64_t matches;
+} ScanCounts;
+
+// Counters and timings of a search, filled in when asked for. Counts are
+// added by scanning threads at once, times in nanoseconds are set by the
+// thread running the search and the binding.
+class SearchStats {
+public:
+    SearchStats() : counts(ScanCounts()), stubChannel(0), stubDx(0),
+        unwrapNs(0), prepareNs(0), scanNs(0), focusNs(0), marshalNs(0) {
+        uv_mutex_init(&mutex);
+    }
+    
+    ~SearchStats() {
+        uv_mutex_destroy(&mutex);
+    }
+    
+    void add(const ScanCounts &scanned) {
+        uv_mutex_lock(&mutex);
+        counts.candidates += scanned.candidates;
+        counts.filtered += scanned.filtered;
+        counts.stubRejected += scanned.stubRejected;
+        counts.verified += scanned.verified;
+        counts.matches += scanned.matches;
+        uv_mutex_unlock(&mutex);
+    }
+    
+    ScanCounts counts;
+    // stub the template was checked by first
+    unsigned int stubChannel;
+    unsigned int stubDx;
+    // input unwrap and copy, template statistics and tables, scan,
+    // suppression of overlapping matches and result marshalling
+    uint64_t unwrapNs;
+    uint64_t prepareNs;
+    uint64_t scanNs;
+    uint64_t focusNs;
+    uint64_t marshalNs;
+
+private:
+    uv_mutex_t mutex;
+    
+    SearchStats(const SearchStats &);
+    SearchStats &operator=(const SearchStats &);
+};
+
+// Receives matches while a search runs, called from scanning threads at once
+class Sink {
+public:
+    virtual ~Sink() {}
+    virtual void emit(const Match *matches, size_t count) = 0;
+};
+
+typedef struct {
+    unsigned int colorTolerance;
+    unsigned int pixelTolerance;
+    // threads to scan candidate rows with
+    unsigned int threads;
+    // levels of window sum elimination, 0 disables it
+    unsigned int prefilter;
+    // resolution levels searched coarse to fine, 1 or less disables it
+    unsigned int pyramid;
+    // skip positions by squared difference computed with FFT
+    bool fft;
+    // suppress overlapping matches and sort by accuracy
+    bool focus;
+    // most accurate matches to return, 0 for all
+    unsigned int maxResults;
+    // stop at the first match in scan order
+    bool firstMatch;
+    // skip template pixels of zero alpha
+    bool mask;
+    // polled to stop early, NULL if the search always runs to the end
+    Stop *stop;
+    // gets matches of every candidate row as it is scanned, unless results are
+    // limited, NULL for none
+    Sink *sink;
+    // counts candidates and times phases, NULL for none
+    SearchStats *stats;
+} SearchOptions;
+
+// Template pixels compared at a position, as runs of adjacent pixels along
+// rows and down columns. Masks leave out pixels of zero alpha, a template
+// compared in full is a single run per row and column.
+class Mask {
+public:
+    typedef struct {
+        unsigned int row;
+        unsigned int col;
+        unsigned int length;
+    } Run;
+    
+    typedef std::vector<Run>::const_iterator Runs;
+    
+    // all pixels of a `rows` x `cols` template
+    Mask(unsigned int rows, unsigned int cols) : opaque((size_t) rows * cols, 1) {
+        index(rows, cols);
+    }
+    
+    // pixels where `alpha` is not zero
+    template <typename Derived>
+    explicit Mask(const Eigen::DenseBase<Derived> &alpha) : opaque((size_t) alpha.rows() * alpha.cols()) {
+        const unsigned int rows = (unsigned int) alpha.rows();
+        const unsigned int cols = (unsigned int) alpha.cols();
+        
+        for (unsigned int y = 0; y < rows; y++) {
+            for (unsigned int x = 0; x < cols; x++) {
+                opaque[(size_t) y * cols + x] = alpha(y, x) != 0;
+            }
+        }
+        
+        index(rows, cols);
+    }
+    
+    // true if no pixel is left out
+    bool full() const {
+        return pixels == opaque.size();
+    }
+    
+    // runs along rows, top to bottom
+    Runs rowsBegin() const {
+        return horizontal.begin();
+    }
+    
+    Runs rowsEnd() const {
+        return horizontal.end();
+    }
+    
+    // runs down column `col`, top to bottom
+    Runs columnBegin(unsigned int col) const {
+        return vertical.begin() + firstVertical[col];
+    }
+    
+    Runs columnEnd(unsigned int col) const {
+        return vertical.begin() + firstVertical[col + 1];
+    }
+    
+    // number of pixels compared
+    size_t pixels;
+
+private:
+    void index(unsigned int rows, unsigned int cols) {
+        pixels = 0;
+        
+        for (unsigned int y = 0; y < rows; y++) {
+            for (unsigned int x = 0; x < cols; x++) {
+                if ( ! opaque[(size_t) y * cols + x]) {
+                    continue;
+                }
+                
+                if (x > 0 && opaque[(size_t) y * cols + x - 1]) {
+                    horizontal.back().length++;
+                } else {
+                    Run run = { y, x, 1 };
+                    horizontal.push_back(run);
+                }
+                
+                pixels++;
+            }
+        }
+        
+        firstVertical.push_back(0);
+        for (unsigned int x = 0; x < cols; x++) {
+            for (unsigned int y = 0; y < rows; y++) {
+                if ( ! opaque[(size_t) y * cols + x]) {
+                    continue;
+                }
+                
+                if (y > 0 && opaque[(size_t) (y - 1) * cols + x]) {
+                    vertical.back().length++;
+                } else {
+                    Run run = { y, x, 1 };
+                    vertical.push_back(run);
+                }
+            }
+            
+            firstVertical.push_back(vertical.size());
+        }
+    }
+    
+    std::vector<unsigned char> opaque;
+    std::vector<Run> horizontal;
+    std::vector<Run> vertical;
+    std::vector<size_t> firstVertical;
+};
+
+template <typename Derived>
+Eigen::RowVectorXf stdDev(const Eigen::MatrixBase<Derived> &channel) {
+    const Eigen::MatrixXf m = channel.template cast<float>();
+    const unsigned int N = (unsigned int) m.rows();
+    return ((m.rowwise() - (m.colwise().sum() / (float) N)).array().square().colwise().sum() / (float) N).array().sqrt();
+}
+
+// Column deviations over pixels of `mask` only, scaled by their share of the
+// column as columns with few of them reject few positions
+template <typename Derived>
+Eigen::RowVectorXf stdDev(const Eigen::MatrixBase<Derived> &channel, const Mask &mask) {
+    Eigen::RowVectorXf out = Eigen::RowVectorXf::Zero(channel.cols());
+    
+    for (unsigned int x = 0; x < (unsigned int) channel.cols(); x++) {
+        float n = 0;
+        float sum = 0;
+        float squares = 0;
+        
+        for (Mask::Runs it = mask.columnBegin(x); it != mask.columnEnd(x); it++) {
+            for (unsigned int y = it->row; y < it->row + it->length; y++) {
+                const float v = (float) channel(y, x);
+                n++;
+                sum += v;
+                squares += v * v;
+            }
+        }
+        
+        if (n > 0) {
+            const float mean = sum / n;
+            out[x] = std::sqrt(std::max(squares / n - mean * mean, 0.0f)) * n / (float) channel.rows();
+        }
+    }
+    
+    return out;
+}
+
+// Transposed copy of one image channel: a column of the image is contiguous
+// here, so the stub column under a position is compared a vector at a time
+// instead of one strided read per sample
+template <typename T>
+class Shadow {
+public:
+    explicit Shadow(const typename Matrix<T>::Channel &channel) :
+        rows((unsigned int) channel.rows()), samples((size_t) channel.rows() * channel.cols()) {
+        const unsigned int cols = (unsigned int) channel.cols();
+        const unsigned int tile = 32;
+        
+        // tiles keep both the rows read and the columns written in cache
+        for (unsigned int y0 = 0; y0 < rows; y0 += tile) {
+            for (unsigned int x0 = 0; x0 < cols; x0 += tile) {
+                const unsigned int y1 = std::min(y0 + tile, rows);
+                const unsigned int x1 = std::min(x0 + tile, cols);
+                
+                for (unsigned int y = y0; y < y1; y++) {
+                    const T *in = Matrix<T>::at(channel, y, x0);
+                    T *out = &samples[(size_t) x0 * rows + y];
+                    
+                    for (unsigned int x = x0; x < x1; x++, out += rows) {
+                        *out = *in;
+                        in += channel.innerStride();
+                    }
+                }
+            }
+        }
+    }
+    
+    // samples of column `col` from row `row` down
+    const T *at(unsigned int row, unsigned int col) const {
+        return &samples[(size_t) col * rows + row];
+    }
+
+private:
+    const unsigned int rows;
+    std::vector<T> samples;
+};
+
+// Compares template against image at a candidate position, generic version
+// evaluates Eigen expressions in float
+template <typename T>
+class Kernel {
+public:
+    typedef typename Matrix<T>::Channel Channel;
+    
+    Kernel(const Matrix<T> &m1, const Matrix<T> &m2, const Shadow<T> &shadow, const Channel &stubM2, unsigned int dx,
+        const Mask &mask, unsigned int colorTolerance, unsigned int pixelTolerance) :
+        m1(m1), m2(m2), shadow(shadow), stub(stubM2.col(dx).template cast<float>()), dx(dx), mask(mask),
+        colorTolerance(colorTolerance), pixelTolerance(pixelTolerance) {}
+    
+    // number of stub column pixels off by more than color tolerance
+    // when template top left corner is placed at (r, c), counting may
+    // stop once it exceeds pixel tolerance
+    unsigned int stubMiss(unsigned int r, unsigned int c) {
+        unsigned int miss = 0;
+        
+        for (Mask::Runs it = mask.columnBegin(dx); it != mask.columnEnd(dx); it++) {
+            const Eigen::Map<const Eigen::Matrix<T, Eigen::Dynamic, 1> > column(shadow.at(r + it->row, c + dx), it->length);
+            stubDiff = (column.template cast<float>() - stub.segment(it->row, it->length)).array().abs();
+            miss += (unsigned int) (stubDiff > (float) colorTolerance).count();
+        }
+        
+        return miss;
+    }
+    
+    // Compares runs of template pixels one by one and gives up as soon as
+    // misses exceed pixel tolerance, accuracy is only set for matches
+    bool verify(unsigned int r, unsigned int c, float *accuracy) {
+        unsigned int miss = 0;
+        float sum = 0;
+        float max = 0;
+        
+        for (Mask::Runs it = mask.rowsBegin(); it != mask.rowsEnd(); it++) {
+            const unsigned int y = it->row;
+            const unsigned int x = it->col;
+            const unsigned int n = it->length;
+            
+            if (m1.channels < 3) {
+                rowDiff  = (m1.k.block(r + y, c + x, 1, n).template cast<float>() - m2.k.block(y, x, 1, n).template cast<float>()).array().abs();
+            } else {
+                rowDiff  = (m1.r.block(r + y, c + x, 1, n).template cast<float>() - m2.r.block(y, x, 1, n).template cast<float>()).array().abs();
+                rowDiff += (m1.g.block(r + y, c + x, 1, n).template cast<float>() - m2.g.block(y, x, 1, n).template cast<float>()).array().abs();
+                rowDiff += (m1.b.block(r + y, c + x, 1, n).template cast<float>() - m2.b.block(y, x, 1, n).template cast<float>()).array().abs();
+            }
+            
+            miss += (unsigned int) (rowDiff > (float) colorTolerance).count();
+            
+            if (miss > pixelTolerance) {
+                return false;
+            }
+            
+            sum += rowDiff.sum();
+            max = std::max(max, rowDiff.maxCoeff());
+        }
+        
+        *accuracy = (max > 0) ? sum / max : 0;
+        
+        return true;
+    }
+
+private:
+    const Matrix<T> &m1;
+    const Matrix<T> &m2;
+    const Shadow<T> &shadow;
+    const Eigen::VectorXf stub;
+    const unsigned int dx;
+    const Mask &mask;
+    const unsigned int colorTolerance;
+    const unsigned int pixelTolerance;
+    Eigen::ArrayXf stubDiff;
+    Eigen::Array<float, 1, Eigen::Dynamic> rowDiff;
+};
+
+// 8-bit samples are compared with saturating integer arithmetic, which
+// keeps reads at one byte per sample and needs no conversion
+template <>
+class Kernel<unsigned char> {
+public:
+    typedef Matrix<unsigned char>::Channel Channel;
+    
+    Kernel(const Matrix<unsigned char> &m1, const Matrix<unsigned char> &m2, const Shadow<unsigned char> &shadow,
+        const Channel &stubM2, unsigned int dx, const Mask &mask, unsigned int colorTolerance, unsigned int pixelTolerance) :
+        shadow(shadow), dx(dx), mask(mask), stubBegin(mask.columnBegin(dx)), stubEnd(mask.columnEnd(dx)),
+        colorTolerance(colorTolerance), pixelTolerance(pixelTolerance) {
+        // template stub is made contiguous too
+        stub.resize(m2.rows);
+        for (unsigned int y = 0; y < m2.rows; y++) {
+            stub[y] = *Matrix<unsigned char>::at(stubM2, y, dx);
+        }
+        
+        if (m1.channels < 3) {
+            planes = 1;
+            m1Planes[0] = &m1.k;
+            m2Planes[0] = &m2.k;
+        } else {
+            planes = 3;
+            m1Planes[0] = &m1.r;
+            m1Planes[1] = &m1.g;
+            m1Planes[2] = &m1.b;
+            m2Planes[0] = &m2.r;
+            m2Planes[1] = &m2.g;
+            m2Planes[2] = &m2.b;
+        }
+    }
+    
+    unsigned int stubMiss(unsigned int r, unsigned int c) {
+        // a template compared in full has a single run
+        if (stubEnd - stubBegin == 1) {
+            return kernelColumnMiss(shadow.at(r + stubBegin->row, c + dx), &stub[stubBegin->row], stubBegin->length,
+                colorTolerance, pixelTolerance);
+        }
+        
+        return stubRunsMiss(r, c);
+    }
+    
+    bool verify(unsigned int r, unsigned int c, float *accuracy) {
+        const unsigned char *img[3];
+        const unsigned char *tpl[3];
+        DiffStats stats = { 0, 0, 0 };
+        
+        const Mask::Runs end = mask.rowsEnd();
+        
+        for (Mask::Runs it = mask.rowsBegin(); it != end; it++) {
+            for (unsigned int p = 0; p < planes; p++) {
+                img[p] = Matrix<unsigned char>::at(*m1Planes[p], r + it->row, c + it->col);
+                tpl[p] = Matrix<unsigned char>::at(*m2Planes[p], it->row, it->col);
+            }
+            
+            kernelRowDiff(img, (unsigned int) m1Planes[0]->innerStride(), tpl, (unsigned int) m2Planes[0]->innerStride(),
+                planes, it->length, colorTolerance, &stats);
+            
+            if (stats.miss > pixelTolerance) {
+                return false;
+            }
+        }
+        
+        *accuracy = (stats.max > 0) ? (float) ((double) stats.sum / stats.max) : 0;
+        
+        return true;
+    }
+
+private:
+    unsigned int stubRunsMiss(unsigned int r, unsigned int c) {
+        unsigned int miss = 0;
+        
+        for (Mask::Runs it = stubBegin; it != stubEnd && miss <= pixelTolerance; it++) {
+            miss += kernelColumnMiss(shadow.at(r + it->row, c + dx), &stub[it->row], it->length,
+                colorTolerance, pixelTolerance - miss);
+        }
+        
+        return miss;
+    }
+    
+    const Shadow<unsigned char> &shadow;
+    std::vector<unsigned char> stub;
+    const Channel *m1Planes[3];
+    const Channel *m2Planes[3];
+    unsigned int planes;
+    const unsigned int dx;
+    const Mask &mask;
+    // runs of the stub column
+    const Mask::Runs stubBegin;
+    const Mask::Runs stubEnd;
+    const unsigned int colorTolerance;
+    const unsigned int pixelTolerance;
+};
+
+// Accumulator of summed-area tables, 8-bit tables wrap around modulo 2^32
+// which keeps window sums exact as long as they fit 32 bits
+template <typename T>
+struct Integral {
+    typedef double Sum;
+};
+
+template <>
+struct Integral<unsigned char> {
+    typedef unsigned int Sum;
+};
+
+// Summed-area table of an image, channel values of a pixel added up
+template <typename T>
+class SummedArea {
+public:
+    typedef typename Integral<T>::Sum Sum;
+    
+    explicit SummedArea(const Matrix<T> &m1) : stride(m1.cols + 1) {
+        const typename Matrix<T>::Channel *planes[3] = { &m1.r, &m1.g, &m1.b };
+        const unsigned int count = (m1.channels < 3) ? 1 : 3;
+        
+        if (count == 1) {
+            planes[0] = &m1.k;
+        }
+        
+        table.assign((size_t) (m1.rows + 1) * stride, 0);
+        for (unsigned int y = 0; y < m1.rows; y++) {
+            Sum row = 0;
+            for (unsigned int x = 0; x < m1.cols; x++) {
+                for (unsigned int p = 0; p < count; p++) {
+                    row += *Matrix<T>::at(*planes[p], y, x);
+                }
+                table[(size_t) (y + 1) * stride + x + 1] = table[(size_t) y * stride + x + 1] + row;
+            }
+        }
+    }
+    
+    // sum of pixels in rows [r0, r1) and columns [c0, c1)
+    Sum window(unsigned int r0, unsigned int c0, unsigned int r1, unsigned int c1) const {
+        return table[(size_t) r1 * stride + c1] - table[(size_t) r0 * stride + c1]
+            - table[(size_t) r1 * stride + c0] + table[(size_t) r0 * stride + c0];
+    }
+
+private:
+    const size_t stride;
+    std::vector<Sum> table;
+};
+
+// Successive elimination: the difference between sums of an image window
+// and the template is a lower bound of their total pixel difference, which
+// color and pixel tolerance bound from above. Level l splits the template
+// into 2^l x 2^l blocks and sums differences of block sums, a tighter bound
+// that is only checked when coarser levels pass.
+template <typename T>
+class Prefilter {
+public:
+    typedef typename Integral<T>::Sum Sum;
+    
+    // `shared` table of the image is used instead of building one
+    Prefilter(const Matrix<T> &m1, const Matrix<T> &m2, unsigned int levels,
+        unsigned int colorTolerance, unsigned int pixelTolerance, const SummedArea<T> *shared = NULL) :
+        owned(shared ? NULL : new SummedArea<T>(m1)), sums(shared ? *shared : *owned) {
+        const typename Matrix<T>::Channel *m1Planes[3];
+        const typename Matrix<T>::Channel *m2Planes[3];
+        unsigned int planes;
+        
+        if (m1.channels < 3) {
+            planes = 1;
+            m1Planes[0] = &m1.k;
+            m2Planes[0] = &m2.k;
+        } else {
+            planes = 3;
+            m1Planes[0] = &m1.r;
+            m1Planes[1] = &m1.g;
+            m1Planes[2] = &m1.b;
+            m2Planes[0] = &m2.r;
+            m2Planes[1] = &m2.g;
+            m2Planes[2] = &m2.b;
+        }
+        
+        // largest possible difference of a pixel from channel value ranges
+        double maxDiff = 0;
+        for (unsigned int p = 0; p < planes; p++) {
+            const double m1Min = (double) m1Planes[p]->minCoeff();
+            const double m1Max = (double) m1Planes[p]->maxCoeff();
+            const double m2Min = (double) m2Planes[p]->minCoeff();
+            const double m2Max = (double) m2Planes[p]->maxCoeff();
+            maxDiff += std::max(m1Max - m2Min, m2Max - m1Min);
+        }
+        
+        const double pixels = (double) m2.rows * m2.cols;
+        const double misses = std::min((double) pixelTolerance, pixels);
+        bound = (pixels - misses) * colorTolerance + misses * std::max(maxDiff, (double) colorTolerance);
+        // float sums are rounded
+        bound += bound * 1e-6 + 1e-3;
+        
+        for (unsigned int l = 0; l < levels; l++) {
+            const unsigned int splits = 1u << l;
+            
+            if (splits > m2.rows || splits > m2.cols) {
+                break;
+            }
+            
+            Level level;
+            level.splits = splits;
+            for (unsigned int i = 0; i <= splits; i++) {
+                level.y.push_back(m2.rows * i / splits);
+                level.x.push_back(m2.cols * i / splits);
+            }
+            
+            for (unsigned int by = 0; by < splits; by++) {
+                for (unsigned int bx = 0; bx < splits; bx++) {
+                    double sum = 0;
+                    for (unsigned int y = level.y[by]; y < level.y[by + 1]; y++) {
+                        for (unsigned int x = level.x[bx]; x < level.x[bx + 1]; x++) {
+                            for (unsigned int p = 0; p < planes; p++) {
+                                sum += *Matrix<T>::at(*m2Planes[p], y, x);
+                            }
+                        }
+                    }
+                    level.sums.push_back(sum);
+                }
+            }
+            
+            this->levels.push_back(level);
+        }
+    }
+    
+    ~Prefilter() {
+        delete owned;
+    }
+    
+    // true if template at (r, c) cannot match
+    bool reject(unsigned int r, unsigned int c) const {
+        for (size_t l = 0; l < levels.size(); l++) {
+            const Level &level = levels[l];
+            double total = 0;
+            
+            for (unsigned int by = 0; by < level.splits; by++) {
+                for (unsigned int bx = 0; bx < level.splits; bx++) {
+                    const Sum sum = sums.window(r + level.y[by], c + level.x[bx], r + level.y[by + 1], c + level.x[bx + 1]);
+                    total += std::fabs((double) sum - level.sums[by * level.splits + bx]);
+                }
+            }
+            
+            if (total > bound) {
+                return true;
+            }
+        }
+        
+        return false;
+    }
+
+private:
+    typedef struct {
+        unsigned int splits;
+        std::vector<unsigned int> y;
+        std::vector<unsigned int> x;
+        std::vector<double> sums;
+    } Level;
+    
+    SummedArea<T> *owned;
+    const SummedArea<T> &sums;
+    std::vector<Level> levels;
+    double bound;
+    
+    Prefilter(const Prefilter &);
+    Prefilter &operator=(const Prefilter &);
+};
+
+// Smallest length not below n without prime factors other than 2, 3 and 5,
+// which FFT transforms fastest
+inline unsigned int fftLength(unsigned int n) {
+    for (;; n++) {
+        unsigned int m = n;
+        while (m % 2 == 0) m /= 2;
+        while (m % 3 == 0) m /= 3;
+        while (m % 5 == 0) m /= 5;
+        
+        if (m == 1) {
+            return n;
+        }
+    }
+}
+
+// In place 2D FFT of a row-major array, rows from `used` on must be zero
+inline void fft2(Eigen::FFT<double> &fft, std::vector<std::complex<double> > &data,
+    unsigned int rows, unsigned int cols, unsigned int used, bool inverse) {
+    std::vector<std::complex<double> > in(std::max(rows, cols));
+    std::vector<std::complex<double> > out(std::max(rows, cols));
+    
+    for (unsigned int y = 0; y < used; y++) {
+        std::complex<double> *row = &data[(size_t) y * cols];
+        std::copy(row, row + cols, in.begin());
+        
+        if (inverse) {
+            fft.inv(row, &in[0], cols);
+        } else {
+            fft.fwd(row, &in[0], cols);
+        }
+    }
+    
+    for (unsigned int x = 0; x < cols; x++) {
+        for (unsigned int y = 0; y < rows; y++) {
+            in[y] = data[(size_t) y * cols + x];
+        }
+        
+        if (inverse) {
+            fft.inv(&out[0], &in[0], rows);
+        } else {
+            fft.fwd(&out[0], &in[0], rows);
+        }
+        
+        for (unsigned int y = 0; y < rows; y++) {
+            data[(size_t) y * cols + x] = out[y];
+        }
+    }
+}
+
+// Transforms of image planes and summed-area table of squared pixels, the
+// part of Correlation that does not depend on the template
+template <typename T>
+class Spectrum {
+public:
+    typedef std::complex<double> Complex;
+    
+    explicit Spectrum(const Matrix<T> &m1) :
+        fftRows(fftLength(m1.rows)), fftCols(fftLength(m1.cols)), stride(m1.cols + 1) {
+        const typename Matrix<T>::Channel *m1Planes[3] = { &m1.r, &m1.g, &m1.b };
+        const unsigned int planes = (m1.channels < 3) ? 1 : 3;
+        const size_t size = (size_t) fftRows * fftCols;
+        
+        if (planes == 1) {
+            m1Planes[0] = &m1.k;
+        }
+        
+        Eigen::FFT<double> fft;
+        
+        for (unsigned int p = 0; p < planes; p++) {
+            const typename Matrix<T>::Channel &i = *m1Planes[p];
+            transforms[p].assign(size, Complex(0));
+            
+            for (unsigned int y = 0; y < m1.rows; y++) {
+                for (unsigned int x = 0; x < m1.cols; x++) {
+                    transforms[p][(size_t) y * fftCols + x] = (double) i(y, x);
+                }
+            }
+            
+            fft2(fft, transforms[p], fftRows, fftCols, m1.rows, false);
+            
+            minimum[p] = (double) i.minCoeff();
+            maximum[p] = (double) i.maxCoeff();
+        }
+        
+        table.assign((size_t) (m1.rows + 1) * stride, 0);
+        for (unsigned int y = 0; y < m1.rows; y++) {
+            double row = 0;
+            for (unsigned int x = 0; x < m1.cols; x++) {
+                for (unsigned int p = 0; p < planes; p++) {
+                    const double value = (double) (*m1Planes[p])(y, x);
+                    row += value * value;
+                }
+                table[(size_t) (y + 1) * stride + x + 1] = table[(size_t) y * stride + x + 1] + row;
+            }
+        }
+    }
+    
+    // sum of squared pixels in rows [r0, r1) and columns [c0, c1)
+    double energy(unsigned int r0, unsigned int c0, unsigned int r1, unsigned int c1) const {
+        return table[(size_t) r1 * stride + c1] - table[(size_t) r0 * stride + c1]
+            - table[(size_t) r1 * stride + c0] + table[(size_t) r0 * stride + c0];
+    }
+    
+    double totalEnergy() const {
+        return table.back();
+    }
+    
+    // circular correlation of valid positions never wraps around
+    const unsigned int fftRows;
+    const unsigned int fftCols;
+    std::vector<Complex> transforms[3];
+    double minimum[3];
+    double maximum[3];
+
+private:
+    const size_t stride;
+    std::vector<double> table;
+};
+
+// Sum of squared differences for all positions at once, expanded into image
+// window energy - 2 * cross-correlation + template energy. Correlation is
+// taken in frequency domain, so cost does not depend on template size. Color
+// and pixel tolerance bound the squared difference of a match from above.
+template <typename T>
+class Correlation {
+public:
+    typedef std::complex<double> Complex;
+    
+    // `shared` spectrum of the image is used instead of transforming it
+    Correlation(const Matrix<T> &m1, const Matrix<T> &m2, unsigned int colorTolerance, unsigned int pixelTolerance,
+        const Spectrum<T> *shared = NULL) : cols(m1.cols - m2.cols + 1) {
+        const typename Matrix<T>::Channel *m2Planes[3] = { &m2.r, &m2.g, &m2.b };
+        const unsigned int planes = (m1.channels < 3) ? 1 : 3;
+        
+        if (planes == 1) {
+            m2Planes[0] = &m2.k;
+        }
+        
+        Spectrum<T> *owned = shared ? NULL : new Spectrum<T>(m1);
+        const Spectrum<T> &spectrum = shared ? *shared : *owned;
+        
+        const unsigned int rows = m1.rows - m2.rows + 1;
+        const unsigned int fftRows = spectrum.fftRows;
+        const unsigned int fftCols = spectrum.fftCols;
+        const size_t size = (size_t) fftRows * fftCols;
+        
+        Eigen::FFT<double> fft;
+        std::vector<Complex> product(size);
+        std::vector<Complex> tpl(size);
+        
+        double templateEnergy = 0;
+        // largest possible squared difference of a pixel and correlation
+        double maxSquare = 0;
+        double peak = 0;
+        
+        for (unsigned int p = 0; p < planes; p++) {
+            const typename Matrix<T>::Channel &t = *m2Planes[p];
+            const std::vector<Complex> &image = spectrum.transforms[p];
+            
+            std::fill(tpl.begin(), tpl.end(), Complex(0));
+            
+            for (unsigned int y = 0; y < m2.rows; y++) {
+                for (unsigned int x = 0; x < m2.cols; x++) {
+                    const double value = (double) t(y, x);
+                    tpl[(size_t) y * fftCols + x] = value;
+                    templateEnergy += value * value;
+                }
+            }
+            
+            fft2(fft, tpl, fftRows, fftCols, m2.rows, false);
+            
+            for (size_t k = 0; k < size; k++) {
+                product[k] += image[k] * std::conj(tpl[k]);
+            }
+            
+            const double m1Min = spectrum.minimum[p];
+            const double m1Max = spectrum.maximum[p];
+            const double m2Min = (double) t.minCoeff();
+            const double m2Max = (double) t.maxCoeff();
+            const double maxDiff = std::max(m1Max - m2Min, m2Max - m1Min);
+            maxSquare += maxDiff * maxDiff;
+            peak += std::max(std::fabs(m1Min), std::fabs(m1Max)) * std::max(std::fabs(m2Min), std::fabs(m2Max));
+        }
+        
+        fft2(fft, product, fftRows, fftCols, fftRows, true);
+        
+        ssd.resize((size_t) rows * cols);
+        for (unsigned int r = 0; r < rows; r++) {
+            for (unsigned int c = 0; c < cols; c++) {
+                const double energy = spectrum.energy(r, c, r + m2.rows, c + m2.cols);
+                ssd[(size_t) r * cols + c] = energy - 2 * product[(size_t) r * fftCols + c].real() + templateEnergy;
+            }
+        }
+        
+        // squared sum of channel differences is not below their sum of squares
+        const double pixels = (double) m2.rows * m2.cols;
+        const double misses = std::min((double) pixelTolerance, pixels);
+        const double tolerance = (double) colorTolerance * colorTolerance;
+        bound = (pixels - misses) * tolerance + misses * std::max(maxSquare, tolerance);
+        // transforms and float sums are rounded
+        bound += (pixels * peak + spectrum.totalEnergy()) * 1e-9 + 1e-3;
+        
+        delete owned;
+    }
+    
+    // true if template at (r, c) cannot match
+    bool reject(unsigned int r, unsigned int c) const {
+        return ssd[(size_t) r * cols + c] > bound;
+    }
+
+private:
+    const unsigned int cols;
+    std::vector<double> ssd;
+    double bound;
+    
+    Correlation(const Correlation &);
+    Correlation &operator=(const Correlation &);
+};
+
+inline bool byPosition(const Match &a, const Match &b) {
+    return (a.row != b.row) ? a.row < b.row : a.col < b.col;
+}
+
+// Most accurate first, ties in scan order
+inline bool better(const Match &a, const Match &b) {
+    return (a.accuracy != b.accuracy) ? a.accuracy < b.accuracy : byPosition(a, b);
+}
+
+// Orders heaps of bounded scans, most accurate first, and drops the excess
+inline void rank(std::vector<Match> &matches, unsigned int limit) {
+    std::sort(matches.begin(), matches.end(), better);
+    
+    if (matches.size() > limit) {
+        matches.resize(limit);
+    }
+}
+
+// Column and channel of the template checked before the rest of it, the
+// column varying the most and the channel varying the most over it
+typedef struct {
+    unsigned int dx;
+    // 0 for K, 1-3 for R, G and B
+    unsigned int channel;
+} Stub;
+
+template <typename T>
+Stub pickStub(const Matrix<T> &m2, bool gray, const Mask *mask = NULL) {
+    Eigen::RowVectorXf devK, devR, devG, devB;
+    Eigen::RowVectorXf dev = Eigen::RowVectorXf::Zero(m2.cols);
+    
+    if (gray) {
+        devK = mask ? stdDev(m2.k, *mask) : stdDev(m2.k);
+        dev += devK;
+    } else {
+        devR = mask ? stdDev(m2.r, *mask) : stdDev(m2.r);
+        devG = mask ? stdDev(m2.g, *mask) : stdDev(m2.g);
+        devB = mask ? stdDev(m2.b, *mask) : stdDev(m2.b);
+        dev += devR + devG + devB;
+    }
+    
+    Eigen::RowVectorXf::Index maxCol;
+    dev.maxCoeff(&maxCol);
+    
+    Stub stub;
+    stub.dx = (unsigned int) maxCol;
+    
+    if (gray) {
+        stub.channel = 0;
+    } else if (devR.sum() > devG.sum()) {
+        stub.channel = 1;
+    } else if (devG.sum() > devB.sum()) {
+        stub.channel = 2;
+    } else {
+        stub.channel = 3;
+    }
+    
+    return stub;
+}
+
+template <typename T>
+class PreparedImage;
+
+// true if template pixels of zero alpha are to be skipped
+template <typename T>
+bool masked(const Matrix<T> &m2, const SearchOptions &options) {
+    return options.mask && m2.a.data() != NULL;
+}
+
+// Picks the stub column and channel from template statistics once, unless
+// given precomputed, then scans candidate rows, ranges of rows can be scanned
+// concurrently. Tables and transforms of a prepared image are shared.
+template <typename T>
+class Searcher {
+public:
+    typedef typename Matrix<T>::Channel Channel;
+    
+    Searcher(const Matrix<T> &m1, const Matrix<T> &m2, const SearchOptions &options, const Stub *stub = NULL,
+        PreparedImage<T> *image = NULL) :
+        m1(m1), m2(m2), colorTolerance(options.colorTolerance), pixelTolerance(options.pixelTolerance),
+        limit(options.maxResults), first(options.firstMatch), stop(options.stop),
+        sink((options.maxResults > 0 || options.firstMatch) ? NULL : options.sink), stats(options.stats),
+        mask(masked(m2, options) ? Mask(m2.a) : Mask(m2.rows, m2.cols)),
+        shadow(NULL), owned(NULL), prefilter(NULL), correlation(NULL) {
+        const bool gray = m1.channels < 3;
+        const bool full = mask.full();
+        
+        // stub of a template prepared for other kind of images or picked
+        // over transparent pixels is of no use
+        const Stub picked = (stub && full && (stub->channel == 0) == gray) ? *stub : pickStub(m2, gray, full ? NULL : &mask);
+        const Channel *m1Planes[4] = { &m1.k, &m1.r, &m1.g, &m1.b };
+        const Channel *m2Planes[4] = { &m2.k, &m2.r, &m2.g, &m2.b };
+        
+        dx = picked.dx;
+        stubM2 = m2Planes[picked.channel];
+        
+        if (image) {
+            shadow = &image->shadow(picked.channel);
+        } else {
+            shadow = owned = new Shadow<T>(*m1Planes[picked.channel]);
+        }
+        
+        if (stats) {
+            stats->stubChannel = picked.channel;
+            stats->stubDx = picked.dx;
+        }
+        
+        // window sums and correlation would count transparent pixels
+        if (options.prefilter > 0 && rows() > 0 && full) {
+            prefilter = new Prefilter<T>(m1, m2, options.prefilter, colorTolerance, pixelTolerance,
+                image ? &image->sums() : NULL);
+        }
+        
+        if (options.fft && rows() > 0 && full) {
+            correlation = new Correlation<T>(m1, m2, colorTolerance, pixelTolerance,
+                image ? &image->spectrum() : NULL);
+        }
+    }
+    
+    ~Searcher() {
+        delete owned;
+        delete prefilter;
+        delete correlation;
+    }
+    
+    // number of candidate rows, zero if template does not fit
+    unsigned int rows() const {
+        return (m1.rows >= m2.rows && m1.cols >= m2.cols) ? m1.rows - m2.rows + 1 : 0;
+    }
+    
+    unsigned int cols() const {
+        return (m1.rows >= m2.rows && m1.cols >= m2.cols) ? m1.cols - m2.cols + 1 : 0;
+    }
+    
+    bool firstMatch() const {
+        return first;
+    }
+    
+    // appends matches with template top edge in rows [begin, end), stops
+    // at the first one in first match mode or when asked to, and keeps `out`
+    // a heap of the least accurate on top when results are limited
+    void scan(unsigned int begin, unsigned int end, std::vector<Match> &out) const {
+        ScanCounts counts = ScanCounts();
+        scanRows(begin, end, out, counts);
+        report(counts);
+    }
+    
+    // appends matches among candidate positions, which must be in range
+    void scan(const std::vector<Match> &candidates, std::vector<Match> &out) const {
+        ScanCounts counts = ScanCounts();
+        scanCandidates(candidates, out, counts);
+        report(counts);
+    }
+
+private:
+    void scanRows(unsigned int begin, unsigned int end, std::vector<Match> &out, ScanCounts &counts) const {
+        Kernel<T> kernel(m1, m2, *shadow, *stubM2, dx, mask, colorTolerance, pixelTolerance);
+        
+        const unsigned int cols = m1.cols - m2.cols + 1;
+        float accuracy = 0;
+        
+        for (unsigned int r = begin; r < end; r++) {
+            if (stop && stop->check()) return;
+            
+            size_t mark = out.size();
+            
+            counts.candidates += cols;
+            
+            for (unsigned int c = 0; c < cols; c++) {
+                if ((correlation && correlation->reject(r, c)) || (prefilter && prefilter->reject(r, c))) {
+                    counts.filtered++;
+                    continue;
+                }
+                
+                if (kernel.stubMiss(r, c) > pixelTolerance) {
+                    counts.stubRejected++;
+                    continue;
+                }
+                
+                counts.verified++;
+                
+                if (kernel.verify(r, c, &accuracy)) {
+                    counts.matches++;
+                    
+                    Match res = {
+                        r,
+                        c,
+                        accuracy
+                    };
+                    
+                    if (add(res, out)) return;
+                }
+            }
+            
+            flush(out, mark);
+        }
+    }
+    
+    void scanCandidates(const std::vector<Match> &candidates, std::vector<Match> &out, ScanCounts &counts) const {
+        Kernel<T> kernel(m1, m2, *shadow, *stubM2, dx, mask, colorTolerance, pixelTolerance);
+        float accuracy = 0;
+        
+        size_t mark = out.size();
+        
+        for (std::vector<Match>::const_iterator it = candidates.begin(); it != candidates.end(); it++) {
+            if (it == candidates.begin() || it->row != (it - 1)->row) {
+                flush(out, mark);
+                
+                if (stop && stop->check()) return;
+            }
+            
+            counts.candidates++;
+            
+            if ((correlation && correlation->reject(it->row, it->col)) || (prefilter && prefilter->reject(it->row, it->col))) {
+                counts.filtered++;
+                continue;
+            }
+            
+            if (kernel.stubMiss(it->row, it->col) > pixelTolerance) {
+                counts.stubRejected++;
+                continue;
+            }
+            
+            counts.verified++;
+            
+            if (kernel.verify(it->row, it->col, &accuracy)) {
+                counts.matches++;
+                
+                Match res = {
+                    it->row,
+                    it->col,
+                    accuracy
+                };
+                
+                if (add(res, out)) return;
+            }
+        }
+        
+        flush(out, mark);
+    }
+    
+    // adds counts of a scanned range to the progress of the search and to
+    // statistics if asked for
+    void report(const ScanCounts &counts) const {
+        if (stop) {
+            stop->advance(counts.candidates);
+        }
+        
+        if (stats) {
+            stats->add(counts);
+        }
+    }
+    
+    // emits matches appended since `mark` and moves it past them
+    void flush(const std::vector<Match> &out, size_t &mark) const {
+        if (sink && out.size() > mark) {
+            sink->emit(&out[mark], out.size() - mark);
+        }
+        
+        mark = out.size();
+    }
+    
+    // true if scanning should stop
+    bool add(const Match &match, std::vector<Match> &out) const {
+        out.push_back(match);
+        
+        if (limit > 0) {
+            std::push_heap(out.begin(), out.end(), better);
+            
+            if (out.size() > limit) {
+                std::pop_heap(out.begin(), out.end(), better);
+                out.pop_back();
+            }
+        }
+        
+        return first;
+    }
+    
+    const Matrix<T> &m1;
+    const Matrix<T> &m2;
+    const unsigned int colorTolerance;
+    const unsigned int pixelTolerance;
+    const unsigned int limit;
+    const bool first;
+    Stop *stop;
+    Sink *sink;
+    SearchStats *stats;
+    const Mask mask;
+    const Channel *stubM2;
+    unsigned int dx;
+    const Shadow<T> *shadow;
+    Shadow<T> *owned;
+    Prefilter<T> *prefilter;
+    Correlation<T> *correlation;
+    
+    Searcher(const Searcher &);
+    Searcher &operator=(const Searcher &);
+};
+
+// Splits candidate rows into bands scanned as separate tiles
+class Bands {
+public:
+    Bands(unsigned int rows, unsigned int count) : rows(rows), count(count), matched(count) {
+        uv_mutex_init(&mutex);
+    }
+    
+    ~Bands() {
+        uv_mutex_destroy(&mutex);
+    }
+    
+    // first match mode needs no bands after the first one with a match
+    void found(unsigned int band) {
+        uv_mutex_lock(&mutex);
+        matched = std::min(matched, band);
+        uv_mutex_unlock(&mutex);
+    }
+    
+    bool needed(unsigned int band) {
+        uv_mutex_lock(&mutex);
+        const bool needed = band < matched;
+        uv_mutex_unlock(&mutex);
+        
+        return needed;
+    }
+    
+    unsigned int begin(unsigned int band) const {
+        return (unsigned int) ((unsigned long long) rows * band / count);
+    }
+    
+    unsigned int end(unsigned int band) const {
+        return begin(band + 1);
+    }
+    
+    const unsigned int rows;
+    const unsigned int count;
+
+private:
+    unsigned int matched;
+    uv_mutex_t mutex;
+};
+
+// Tile of a search, one band of candidate rows
+template <typename T>
+class BandScan : public Task {
+public:
+    BandScan(const Searcher<T> &searcher, Bands &bands, unsigned int band, std::vector<Match> &out) :
+        searcher(searcher), bands(bands), band(band), out(out) {}
+    
+    void run() {
+        if ( ! searcher.firstMatch()) {
+            searcher.scan(bands.begin(band), bands.end(band), out);
+            return;
+        }
+        
+        // row by row, so that a match in an earlier band cuts this one short
+        for (unsigned int r = bands.begin(band); r < bands.end(band) && bands.needed(band); r++) {
+            searcher.scan(r, r + 1, out);
+            
+            if ( ! out.empty()) {
+                bands.found(band);
+            }
+        }
+    }
+
+private:
+    const Searcher<T> &searcher;
+    Bands &bands;
+    const unsigned int band;
+    std::vector<Match> &out;
+};
+
+// adds time spent preparing a search until `prepared` and scanning since
+inline void timePhases(SearchStats *stats, uint64_t start, uint64_t prepared) {
+    if (stats) {
+        stats->prepareNs += prepared - start;
+        stats->scanNs += uv_hrtime() - prepared;
+    }
+}
+
+// Scans tiles of candidate rows on up to `options.threads` threads at once, one
+// of them the caller and the rest idle threads of `pool` stealing tiles, matches
+// come out in the same order as from a single thread
+template <typename T>
+std::vector<Match> search(const Matrix<T> &m1, const Matrix<T> &m2, const SearchOptions &options, Pool *pool = NULL,
+    const Stub *stub = NULL, PreparedImage<T> *image = NULL) {
+    const uint64_t start = uv_hrtime();
+    Searcher<T> searcher(m1, m2, options, stub, image);
+    const uint64_t prepared = uv_hrtime();
+    const unsigned int threads = options.threads;
+    const unsigned int rows = searcher.rows();
+    
+    std::vector<Match> out;
+    
+    if (threads < 2 || ! pool || rows < 2) {
+        searcher.scan(0, rows, out);
+        
+        if (options.maxResults > 0) {
+            rank(out, options.maxResults);
+        }
+        
+        timePhases(options.stats, start, prepared);
+        
+        return out;
+    }
+    
+    // more tiles than threads evens out rows that are slower to scan
+    const unsigned int count = (threads * 4 < rows) ? threads * 4 : rows;
+    Bands bands(rows, count);
+    std::vector<std::vector<Match> > results(count);
+    
+    std::vector<BandScan<T> > scans;
+    scans.reserve(count);
+    std::vector<Task*> tasks(count);
+    for (unsigned int i = 0; i < count; i++) {
+        scans.push_back(BandScan<T>(searcher, bands, i, results[i]));
+        tasks[i] = &scans[i];
+    }
+    
+    pool->run(&tasks[0], count, threads);
+    
+    for (unsigned int i = 0; i < count; i++) {
+        out.insert(out.end(), results[i].begin(), results[i].end());
+    }
+    
+    // bands before the first match have none
+    if (options.firstMatch && out.size() > 1) {
+        out.resize(1);
+    }
+    
+    if (options.maxResults > 0) {
+        rank(out, options.maxResults);
+    }
+    
+    timePhases(options.stats, start, prepared);
+    
+    return out;
+}
+
+inline unsigned char mean4(unsigned char a, unsigned char b, unsigned char c, unsigned char d) {
+    return (unsigned char) ((a + b + c + d + 2) >> 2);
+}
+
+inline float mean4(float a, float b, float c, float d) {
+    return (a + b + c + d) / 4;
+}
+
+// Half resolution copy of a matrix from given offset on, 2x2 pixel blocks are
+// averaged and alpha channel is dropped
+template <typename T>
+class Octave {
+public:
+    Octave(const Matrix<T> &source, unsigned int rowOffset, unsigned int colOffset) :
+        matrix(halve(source, rowOffset, colOffset, planes)) {}
+    
+    std::vector<T> planes[3];
+    const Matrix<T> matrix;
+
+private:
+    static Matrix<T> halve(const Matrix<T> &source, unsigned int rowOffset, unsigned int colOffset, std::vector<T> *planes) {
+        const unsigned int rows = (source.rows - rowOffset) / 2;
+        const unsigned int cols = (source.cols - colOffset) / 2;
+        const unsigned int count = (source.channels < 3) ? 1 : 3;
+        const typename Matrix<T>::Channel *channels[3] = { &source.r, &source.g, &source.b };
+        const T *data[3] = { NULL, NULL, NULL };
+        
+        if (count == 1) {
+            channels[0] = &source.k;
+        }
+        
+        for (unsigned int p = 0; p < count; p++) {
+            const typename Matrix<T>::Channel &channel = *channels[p];
+            planes[p].resize((size_t) rows * cols);
+            
+            for (unsigned int y = 0; y < rows; y++) {
+                const unsigned int sy = rowOffset + 2 * y;
+                
+                for (unsigned int x = 0; x < cols; x++) {
+                    const unsigned int sx = colOffset + 2 * x;
+                    planes[p][(size_t) y * cols + x] = mean4(
+                        channel(sy, sx), channel(sy, sx + 1),
+                        channel(sy + 1, sx), channel(sy + 1, sx + 1));
+                }
+            }
+            
+            data[p] = planes[p].empty() ? NULL : &planes[p][0];
+        }
+        
+        Matrix<T> out = {
+            rows,
+            cols,
+            count,
+            Matrix<T>::map((count == 1) ? data[0] : NULL, rows, cols, 1),
+            Matrix<T>::map((count == 3) ? data[0] : NULL, rows, cols, 1),
+            Matrix<T>::map(data[1], rows, cols, 1),
+            Matrix<T>::map(data[2], rows, cols, 1),
+            Matrix<T>::map(NULL, rows, cols, 1)
+        };
+        
+        return out;
+    }
+    
+    Octave(const Octave &);
+    Octave &operator=(const Octave &);
+};
+
+// Template copies halved `levels` times from each of the 2^levels x 2^levels
+// offsets, with stubs picked for each copy
+template <typename T>
+class Phases {
+public:
+    Phases(const Matrix<T> &m2, unsigned int levels) {
+        // copies of the previous level
+        std::vector<Octave<T>*> previous(1, static_cast<Octave<T>*>(NULL));
+        rowOffsets.assign(1, 0);
+        colOffsets.assign(1, 0);
+        
+        for (unsigned int l = 1; l <= levels; l++) {
+            std::vector<Octave<T>*> current;
+            std::vector<unsigned int> currentRows;
+            std::vector<unsigned int> currentCols;
+            
+            for (size_t i = 0; i < previous.size(); i++) {
+                const Matrix<T> &source = previous[i] ? previous[i]->matrix : m2;
+                
+                for (unsigned int dy = 0; dy < 2; dy++) {
+                    for (unsigned int dx = 0; dx < 2; dx++) {
+                        current.push_back(new Octave<T>(source, dy, dx));
+                        currentRows.push_back(rowOffsets[i] + (dy << (l - 1)));
+                        currentCols.push_back(colOffsets[i] + (dx << (l - 1)));
+                    }
+                }
+            }
+            
+            octaves.insert(octaves.end(), current.begin(), current.end());
+            previous.swap(current);
+            rowOffsets.swap(currentRows);
+            colOffsets.swap(currentCols);
+        }
+        
+        copies = previous;
+        for (size_t i = 0; i < copies.size(); i++) {
+            stubs.push_back(pickStub(copies[i]->matrix, copies[i]->matrix.channels < 3));
+        }
+    }
+    
+    ~Phases() {
+        for (size_t i = 0; i < octaves.size(); i++) {
+            delete octaves[i];
+        }
+    }
+    
+    // coarsest copies, offsets of their top left pixel in the template and stubs
+    std::vector<Octave<T>*> copies;
+    std::vector<unsigned int> rowOffsets;
+    std::vector<unsigned int> colOffsets;
+    std::vector<Stub> stubs;
+
+private:
+    std::vector<Octave<T>*> octaves;
+    
+    Phases(const Phases &);
+    Phases &operator=(const Phases &);
+};
+
+// Template precomputation reused across searches, possibly running at once,
+// pixel data must outlive it
+template <typename T>
+class Prepared {
+public:
+    explicit Prepared(const Matrix<T> &matrix) : matrix(matrix), stub(pickStub(matrix, matrix.channels < 3)) {
+        uv_mutex_init(&mutex);
+    }
+    
+    ~Prepared() {
+        for (size_t i = 0; i < cache.size(); i++) {
+            delete cache[i];
+        }
+        
+        uv_mutex_destroy(&mutex);
+    }
+    
+    // pyramid copies are built by the first search that needs them
+    const Phases<T> &phases(unsigned int levels) {
+        uv_mutex_lock(&mutex);
+        
+        if (cache.size() <= levels) {
+            cache.resize(levels + 1, NULL);
+        }
+        
+        if ( ! cache[levels]) {
+            cache[levels] = new Phases<T>(matrix, levels);
+        }
+        
+        const Phases<T> &out = *cache[levels];
+        uv_mutex_unlock(&mutex);
+        
+        return out;
+    }
+    
+    const Matrix<T> matrix;
+    const Stub stub;
+
+private:
+    std::vector<Phases<T>*> cache;
+    uv_mutex_t mutex;
+    
+    Prepared(const Prepared &);
+    Prepared &operator=(const Prepared &);
+};
+
+// Coarse to fine search: image is halved L = `options.pyramid - 1` times and
+// template is halved from each of the 2^L x 2^L offsets, so that some copy is
+// block aligned with the image wherever it matches. A mean of pixels within
+// tolerance is within tolerance as well (plus rounding), so coarse copies miss
+// no more pixels than the template does and no match is lost. Coarse hits map
+// back to exactly one position that is verified at full resolution.
+template <typename T>
+std::vector<Match> pyramidSearch(const Matrix<T> &m1, const Matrix<T> &m2, const SearchOptions &options, Pool *pool = NULL,
+    Prepared<T> *prepared = NULL, PreparedImage<T> *image = NULL) {
+    // coarsest template copies are kept at least 4x4 pixels, gray and color
+    // data can not be compared once alpha is dropped, nor can transparent
+    // pixels be told apart in coarse copies
+    unsigned int levels = 0;
+    
+    if ((m1.channels < 3) == (m2.channels < 3) && ! (masked(m2, options) && ! Mask(m2.a).full())) {
+        while (levels + 1 < options.pyramid && levels < 3) {
+            const unsigned int block = 2u << levels;
+            
+            if (m2.rows < block || m2.cols < block ||
+                ((m2.rows - block + 1) >> (levels + 1)) < 4 ||
+                ((m2.cols - block + 1) >> (levels + 1)) < 4) {
+                break;
+            }
+            
+            levels++;
+        }
+    }
+    
+    if (levels == 0) {
+        return search(m1, m2, options, pool, prepared ? &prepared->stub : NULL, image);
+    }
+    
+    const uint64_t start = uv_hrtime();
+    Phases<T> *built = prepared ? NULL : new Phases<T>(m2, levels);
+    const Phases<T> &phases = prepared ? prepared->phases(levels) : *built;
+    
+    // tables and transforms of the coarsest image are shared by all copies
+    PreparedImage<T> *local = image ? NULL : new PreparedImage<T>(m1);
+    PreparedImage<T> &coarsest = (image ? image : local)->octave(levels);
+    
+    // every level of rounded means may shift each channel by one
+    // and every hit is needed as a candidate
+    SearchOptions coarse = options;
+    coarse.colorTolerance = options.colorTolerance + levels * ((m1.channels < 3) ? 1 : 3);
+    coarse.maxResults = 0;
+    coarse.firstMatch = false;
+    coarse.sink = NULL;
+    // coarse levels are timed as part of the scan, only full resolution
+    // candidates are counted
+    coarse.stats = NULL;
+    
+    // few candidates are left, transforming the whole image does not pay off
+    SearchOptions exact = options;
+    exact.fft = false;
+    
+    Searcher<T> searcher(m1, m2, exact, prepared ? &prepared->stub : NULL, image);
+    const uint64_t ready = uv_hrtime();
+    const unsigned int rows = searcher.rows();
+    const unsigned int cols = searcher.cols();
+    
+    std::vector<Match> candidates;
+    
+    for (size_t i = 0; i < phases.copies.size(); i++) {
+        const std::vector<Match> hits = search(coarsest.matrix, phases.copies[i]->matrix, coarse, pool, &phases.stubs[i], &coarsest);
+        
+        for (std::vector<Match>::const_iterator it = hits.begin(); it != hits.end(); it++) {
+            const unsigned int row = it->row << levels;
+            const unsigned int col = it->col << levels;
+            
+            if (row < phases.rowOffsets[i] || col < phases.colOffsets[i] ||
+                row - phases.rowOffsets[i] >= rows || col - phases.colOffsets[i] >= cols) {
+                continue;
+            }
+            
+            Match candidate = { row - phases.rowOffsets[i], col - phases.colOffsets[i], 0 };
+            candidates.push_back(candidate);
+        }
+    }
+    
+    // offsets differ between copies so candidates are unique
+    std::sort(candidates.begin(), candidates.end(), byPosition);
+    
+    std::vector<Match> out;
+    searcher.scan(candidates, out);
+    
+    if (options.maxResults > 0) {
+        rank(out, options.maxResults);
+    }
+    
+    timePhases(options.stats, start, ready);
+    
+    delete local;
+    delete built;
+    
+    return out;
+}
+
+// Image precomputation shared by searches for different templates, possibly
+// running at once, each part is built by the first search that needs it.
+// Pixel data must outlive it.
+template <typename T>
+class PreparedImage {
+public:
+    explicit PreparedImage(const Matrix<T> &matrix) : matrix(matrix), summedArea(NULL), transforms(NULL) {
+        std::fill(shadows, shadows + 4, (Shadow<T>*) NULL);
+        uv_mutex_init(&mutex);
+    }
+    
+    ~PreparedImage() {
+        delete summedArea;
+        delete transforms;
+        
+        for (unsigned int i = 0; i < 4; i++) {
+            delete shadows[i];
+        }
+        
+        for (size_t i = 0; i < octaves.size(); i++) {
+            delete coarse[i];
+            delete octaves[i];
+        }
+        
+        uv_mutex_destroy(&mutex);
+    }
+    
+    const SummedArea<T> &sums() {
+        uv_mutex_lock(&mutex);
+        
+        if ( ! summedArea) {
+            summedArea = new SummedArea<T>(matrix);
+        }
+        
+        uv_mutex_unlock(&mutex);
+        
+        return *summedArea;
+    }
+    
+    const Spectrum<T> &spectrum() {
+        uv_mutex_lock(&mutex);
+        
+        if ( ! transforms) {
+            transforms = new Spectrum<T>(matrix);
+        }
+        
+        uv_mutex_unlock(&mutex);
+        
+        return *transforms;
+    }
+    
+    // transposed channel, 0 for K and 1 to 3 for RGB
+    const Shadow<T> &shadow(unsigned int channel) {
+        const typename Matrix<T>::Channel *planes[4] = { &matrix.k, &matrix.r, &matrix.g, &matrix.b };
+        
+        uv_mutex_lock(&mutex);
+        
+        if ( ! shadows[channel]) {
+            shadows[channel] = new Shadow<T>(*planes[channel]);
+        }
+        
+        uv_mutex_unlock(&mutex);
+        
+        return *shadows[channel];
+    }
+    
+    // image halved `level` times, from 1 on, with tables of its own
+    PreparedImage &octave(unsigned int level) {
+        uv_mutex_lock(&mutex);
+        
+        while (octaves.size() < level) {
+            octaves.push_back(new Octave<T>(octaves.empty() ? matrix : octaves.back()->matrix, 0, 0));
+            coarse.push_back(new PreparedImage(octaves.back()->matrix));
+        }
+        
+        PreparedImage &out = *coarse[level - 1];
+        uv_mutex_unlock(&mutex);
+        
+        return out;
+    }
+    
+    const Matrix<T> matrix;
+
+private:
+    SummedArea<T> *summedArea;
+    Spectrum<T> *transforms;
+    Shadow<T> *shadows[4];
+    std::vector<Octave<T>*> octaves;
+    std::vector<PreparedImage*> coarse;
+    uv_mutex_t mutex;
+    
+    PreparedImage(const PreparedImage &);
+    PreparedImage &operator=(const PreparedImage &);
+};
+
+// Tile of candidate rows for several templates: each row is tried with every
+// template that fits there before the next one, so image rows are read from
+// cache by all but the first template
+template <typename T>
+class BatchScan : public Task {
+public:
+    BatchScan(const std::vector<Searcher<T>*> &searchers, Bands &bands, unsigned int band,
+        std::vector<std::vector<Match> > &out) :
+        searchers(searchers), bands(bands), band(band), out(out) {}
+    
+    void run() {
+        for (unsigned int r = bands.begin(band); r < bands.end(band); r++) {
+            for (size_t t = 0; t < searchers.size(); t++) {
+                const Searcher<T> &searcher = *searchers[t];
+                
+                if (r >= searcher.rows() || (searcher.firstMatch() && ! out[t].empty())) {
+                    continue;
+                }
+                
+                searcher.scan(r, r + 1, out[t]);
+            }
+        }
+    }
+
+private:
+    const std::vector<Searcher<T>*> &searchers;
+    Bands &bands;
+    const unsigned int band;
+    std::vector<std::vector<Match> > &out;
+};
+
+// Searches for several templates in one pass over the image, matches come out
+// per template the same as from search(). `prepared` templates, if given, are
+// paired by index and may be NULL. Tables and transforms of the image are built
+// once for all templates, pyramid and FFT searches go template by template.
+template <typename T>
+std::vector<std::vector<Match> > searchMany(const Matrix<T> &m1, const std::vector<Matrix<T> > &templates,
+    const SearchOptions &options, Pool *pool = NULL, const std::vector<Prepared<T>*> *prepared = NULL,
+    PreparedImage<T> *image = NULL) {
+    PreparedImage<T> local(m1);
+    const size_t count = templates.size();
+    std::vector<std::vector<Match> > out(count);
+    
+    if ( ! image) {
+        image = &local;
+    }
+    
+    // correlation maps are image sized, keeping one per template at once
+    // would not pay off
+    if (options.pyramid > 1 || options.fft) {
+        for (size_t t = 0; t < count; t++) {
+            Prepared<T> *p = prepared ? (*prepared)[t] : NULL;
+            out[t] = (options.pyramid > 1) ? pyramidSearch(m1, templates[t], options, pool, p, image) :
+                search(m1, templates[t], options, pool, p ? &p->stub : NULL, image);
+        }
+        
+        return out;
+    }
+    
+    std::vector<Searcher<T>*> searchers(count);
+    unsigned int rows = 0;
+    
+    for (size_t t = 0; t < count; t++) {
+        Prepared<T> *p = prepared ? (*prepared)[t] : NULL;
+        searchers[t] = new Searcher<T>(m1, templates[t], options, p ? &p->stub : NULL, image);
+        rows = std::max(rows, searchers[t]->rows());
+    }
+    
+    const unsigned int threads = (pool && rows > 1) ? std::max(options.threads, 1u) : 1;
+    const unsigned int bandCount = (threads > 1) ? std::min(threads * 4, rows) : 1;
+    Bands bands(rows, bandCount);
+    std::vector<std::vector<std::vector<Match> > > results(bandCount, std::vector<std::vector<Match> >(count));
+    
+    std::vector<BatchScan<T> > scans;
+    scans.reserve(bandCount);
+    std::vector<Task*> tasks(bandCount);
+    for (unsigned int i = 0; i < bandCount; i++) {
+        scans.push_back(BatchScan<T>(searchers, bands, i, results[i]));
+        tasks[i] = &scans[i];
+    }
+    
+    if (threads > 1) {
+        pool->run(&tasks[0], bandCount, threads);
+    } else {
+        tasks[0]->run();
+    }
+    
+    for (size_t t = 0; t < count; t++) {
+        for (unsigned int b = 0; b < bandCount; b++) {
+            out[t].insert(out[t].end(), results[b][t].begin(), results[b][t].end());
+        }
+        
+        if (options.firstMatch && out[t].size() > 1) {
+            out[t].resize(1);
+        }
+        
+        if (options.maxResults > 0) {
+            rank(out[t], options.maxResults);
+        }
+        
+        delete searchers[t];
+    }
+    
+    return out;
+}
+
+inline bool byAccuracy(const Match &a, const Match &b) {
+    return a.accuracy < b.accuracy;
+}
+
+// Suppresses overlapping matches, those closer than template size on both axes.
+// Matches are taken in scan order, each one overlapping a kept match is dropped
+// but replaces every such kept match it is more accurate than. Kept matches are
+// bucketed by template sized cells, so only neighboring cells are compared.
+// Result is sorted by accuracy, ties keep their order.
+inline std::vector<Match> focus(const std::vector<Match> &matches, unsigned int rows, unsigned int cols) {
+    std::vector<Match> kept;
+    
+    if (rows == 0 || cols == 0 || matches.size() < 2) {
+        kept = matches;
+        std::stable_sort(kept.begin(), kept.end(), byAccuracy);
+        return kept;
+    }
+    
+    unsigned int maxRow = 0;
+    unsigned int maxCol = 0;
+    for (std::vector<Match>::const_iterator it = matches.begin(); it != matches.end(); it++) {
+        maxRow = std::max(maxRow, it->row);
+        maxCol = std::max(maxCol, it->col);
+    }
+    
+    const unsigned int gridRows = maxRow / rows + 1;
+    const unsigned int gridCols = maxCol / cols + 1;
+    std::vector<std::vector<size_t> > grid((size_t) gridRows * gridCols);
+    std::vector<bool> removed;
+    std::vector<size_t> replaced;
+    
+    for (std::vector<Match>::const_iterator it = matches.begin(); it != matches.end(); it++) {
+        const unsigned int gy = it->row / rows;
+        const unsigned int gx = it->col / cols;
+        bool overlaps = false;
+        replaced.clear();
+        
+        for (unsigned int y = (gy > 0 ? gy - 1 : 0); y <= gy + 1 && y < gridRows; y++) {
+            for (unsigned int x = (gx > 0 ? gx - 1 : 0); x <= gx + 1 && x < gridCols; x++) {
+                const std::vector<size_t> &cell = grid[(size_t) y * gridCols + x];
+                
+                for (size_t i = 0; i < cell.size(); i++) {
+                    const Match &other = kept[cell[i]];
+                    
+                    if ((other.row > it->row ? other.row - it->row : it->row - other.row) >= rows ||
+                        (other.col > it->col ? other.col - it->col : it->col - other.col) >= cols) {
+                        continue;
+                    }
+                    
+                    overlaps = true;
+                    if (it->accuracy < other.accuracy) {
+                        replaced.push_back(cell[i]);
+                    }
+                }
+            }
+        }
+        
+        if ( ! overlaps) {
+            grid[(size_t) gy * gridCols + gx].push_back(kept.size());
+            kept.push_back(*it);
+            removed.push_back(false);
+            continue;
+        }
+        
+        if (replaced.empty()) {
+            continue;
+        }
+        
+        // earliest replaced match takes the new position, the rest would
+        // only duplicate it
+        std::sort(replaced.begin(), replaced.end());
+        
+        for (size_t i = 0; i < replaced.size(); i++) {
+            const Match &old = kept[replaced[i]];
+            std::vector<size_t> &cell = grid[(size_t) (old.row / rows) * gridCols + old.col / cols];
+            cell.erase(std::find(cell.begin(), cell.end(), replaced[i]));
+            removed[replaced[i]] = i > 0;
+        }
+        
+        kept[replaced[0]] = *it;
+        grid[(size_t) gy * gridCols + gx].push_back(replaced[0]);
+    }
+    
+    std::vector<Match> out;
+    for (size_t i = 0; i < kept.size(); i++) {
+        if ( ! removed[i]) {
+            out.push_back(kept[i]);
+        }
+    }
+    
+    std::stable_sort(out.begin(), out.end(), byAccuracy);
+    
+    return out;
+}
+
+#endif
@@ -0,0 +1,113 @@
+#include <node.h>
+
+#include "handle.h"
+
+using namespace v8;
+
+Persistent<FunctionTemplate> SearchHandle::constructor;
+
+void SearchHandle::Init() {
+    Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+    tpl->SetClassName(String::NewSymbol("SearchHandle"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    
+    NODE_SET_PROTOTYPE_METHOD(tpl, "cancel", Cancel);
+    
+    constructor = Persistent<FunctionTemplate>::New(tpl);
+}
+
+Local<Object> SearchHandle::NewInstance() {
+    HandleScope scope;
+    
+    return scope.Close(constructor->GetFunction()->NewInstance());
+}
+
+Handle<Value> SearchHandle::New(const Arguments& args) {
+    HandleScope scope;
+    
+    SearchHandle *handle = new SearchHandle();
+    handle->Wrap(args.This());
+    
+    return args.This();
+}
+
+// cancel() stops the search at the next candidate row, no-op once it is done
+Handle<Value> SearchHandle::Cancel(const Arguments& args) {
+    HandleScope scope;
+    
+    node::ObjectWrap::Unwrap<SearchHandle>(args.This())->stop.cancel();
+    
+    return Undefined();
+}
+
+MatchStream::MatchStream(Handle<Function> callback, Stop *stop) :
+    callback(Persistent<Function>::New(callback)), stop(stop) {
+    uv_mutex_init(&mutex);
+    uv_async_init(uv_default_loop(), &async, wake);
+    async.data = this;
+}
+
+MatchStream::~MatchStream() {
+    callback.Dispose();
+    uv_mutex_destroy(&mutex);
+}
+
+// called on scanning threads, sends are coalesced into one callback
+void MatchStream::emit(const Match *matches, size_t count) {
+    uv_mutex_lock(&mutex);
+    pending.insert(pending.end(), matches, matches + count);
+    uv_mutex_unlock(&mutex);
+    
+    uv_async_send(&async);
+}
+
+void MatchStream::close() {
+    drain();
+    uv_close((uv_handle_t*) &async, closed);
+}
+
+void MatchStream::drain() {
+    HandleScope scope;
+    std::vector<Match> matches;
+    
+    uv_mutex_lock(&mutex);
+    matches.swap(pending);
+    uv_mutex_unlock(&mutex);
+    
+    if (matches.empty()) {
+        return;
+    }
+    
+    Local<Array> out = Array::New((int) matches.size());
+    
+    Local<String> row = String::New("row");
+    Local<String> col = String::New("col");
+    Local<String> accuracy = String::New("accuracy");
+    
+    for (size_t i = 0; i < matches.size(); i++) {
+        Local<Object> match = Object::New();
+        match->Set(row, Number::New(matches[i].row));
+        match->Set(col, Number::New(matches[i].col));
+        match->Set(accuracy, Number::New(matches[i].accuracy));
+        
+        out->Set((uint32_t) i, match);
+    }
+    
+    TryCatch tryCatch;
+    Handle<Value> argv[] = { out };
+    Handle<Value> result = callback->Call(Context::GetCurrent()->Global(), 1, argv);
+    
+    if (tryCatch.HasCaught()) {
+        node::FatalException(tryCatch);
+    } else if (result->IsFalse()) {
+        stop->cancel();
+    }
+}
+
+void MatchStream::wake(uv_async_t *async, int status) {
+    static_cast<MatchStream*>(async->data)->drain();
+}
+
+void MatchStream::closed(uv_handle_t *handle) {
+    delete static_cast<MatchStream*>(handle->data);
+}
@@ -0,0 +1,56 @@
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#include <vector>
+
+#include <node.h>
+
+#include "engine.h"
+
+using namespace v8;
+
+// Returned by a search to cancel it, owns the stop request the search
+// polls. Search keeps its handle alive until it calls back.
+class SearchHandle : public node::ObjectWrap {
+public:
+    static void Init();
+    static Local<Object> NewInstance();
+    
+    Stop stop;
+
+private:
+    static Handle<Value> New(const Arguments& args);
+    static Handle<Value> Cancel(const Arguments& args);
+    static Persistent<FunctionTemplate> constructor;
+};
+
+// Hands matches found by scanning threads over to a JS callback on the loop
+// thread, a callback returning false cancels the search. Freed by close(),
+// once the search is done.
+class MatchStream : public Sink {
+public:
+    MatchStream(Handle<Function> callback, Stop *stop);
+    
+    void emit(const Match *matches, size_t count);
+    
+    // calls back matches not called back yet, then frees the stream
+    void close();
+
+private:
+    ~MatchStream();
+    
+    void drain();
+    static void wake(uv_async_t *async, int status);
+    static void closed(uv_handle_t *handle);
+    
+    uv_async_t async;
+    uv_mutex_t mutex;
+    std::vector<Match> pending;
+    Persistent<Function> callback;
+    Stop *stop;
+    
+    MatchStream(const MatchStream &);
+    MatchStream &operator=(const MatchStream &);
+};
+
+#endif
@@ -0,0 +1,75 @@
+#include <node.h>
+
+#include "image.h"
+
+using namespace v8;
+
+Persistent<FunctionTemplate> Image::constructor;
+
+Image::Image() : uint8(NULL), float32(NULL) {}
+
+Image::~Image() {
+    delete uint8;
+    delete float32;
+    
+    V8::AdjustAmountOfExternalAllocatedMemory(-(int) storage.size());
+}
+
+void Image::Init(Handle<Object> exports) {
+    Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+    tpl->SetClassName(String::NewSymbol("Image"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    
+    constructor = Persistent<FunctionTemplate>::New(tpl);
+    exports->Set(String::NewSymbol("Image"), constructor->GetFunction());
+}
+
+bool Image::HasInstance(Handle<Value> value) {
+    return ! constructor.IsEmpty() && value->IsObject() && constructor->HasInstance(value);
+}
+
+// new Image(matrix) takes the same matrix object as search()
+Handle<Value> Image::New(const Arguments& args) {
+    HandleScope scope;
+    
+    if ( ! args.IsConstructCall()) {
+        Handle<Value> argv[] = { args[0] };
+        return scope.Close(constructor->GetFunction()->NewInstance(1, argv));
+    }
+    
+    Cargo m;
+    std::string error = unwrapMatrix(args[0], "matrix", &m, Array::New());
+    
+    // empty images have nothing to search in
+    if (error.empty() && (m.rows < 1 || m.cols < 1)) {
+        error = "Bad argument 'matrix'";
+    }
+    
+    if ( ! error.empty()) {
+        return ThrowException(Exception::TypeError(String::New(error.c_str())));
+    }
+    
+    Image *t = new Image();
+    
+    // rows start at cache line boundaries, interleaved pixels stay
+    // interleaved for vector kernels
+    copyPixels(&m, t->storage, 64);
+    t->cargo = m;
+    
+    if (m.type == PIXEL_UINT8) {
+        t->uint8 = new PreparedImage<unsigned char>(unpack<unsigned char>(m));
+    } else {
+        t->float32 = new PreparedImage<float>(unpack<float>(m));
+    }
+    
+    V8::AdjustAmountOfExternalAllocatedMemory((int) t->storage.size());
+    
+    t->Wrap(args.This());
+    
+    args.This()->Set(String::New("rows"), Integer::NewFromUnsigned(m.rows), ReadOnly);
+    args.This()->Set(String::New("cols"), Integer::NewFromUnsigned(m.cols), ReadOnly);
+    args.This()->Set(String::New("channels"), Integer::NewFromUnsigned(m.channels), ReadOnly);
+    args.This()->Set(String::New("type"), String::New(m.type == PIXEL_FLOAT ? "float" : "uint8"), ReadOnly);
+    
+    return args.This();
+}
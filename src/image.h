@@ -0,0 +1,32 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include <node.h>
+
+#include "search.h"
+
+using namespace v8;
+
+// Image pixels copied once into rows padded to cache lines, along with the
+// tables, transforms and octaves that searches for many templates share
+class Image : public node::ObjectWrap {
+public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Handle<Value> value);
+    
+    // owned pixels, one of the prepared pointers is set by pixel type
+    Cargo cargo;
+    PreparedImage<unsigned char> *uint8;
+    PreparedImage<float> *float32;
+
+private:
+    Image();
+    ~Image();
+    
+    static Handle<Value> New(const Arguments& args);
+    static Persistent<FunctionTemplate> constructor;
+    
+    PixelStorage storage;
+};
+
+#endif
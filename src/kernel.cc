@@ -0,0 +1,163 @@
+#include <cstring>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#elif defined(__i386__) || defined(__x86_64__)
+#include <cpuid.h>
+#endif
+
+#include "kernel.h"
+
+RowDiff kernelRowDiff = rowDiff;
+ColumnMiss kernelColumnMiss = columnMiss;
+
+void rowDiff(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats) {
+    unsigned int miss = 0;
+    unsigned long long sum = 0;
+    unsigned int max = stats->max;
+    
+    for (unsigned int x = 0; x < n; x++) {
+        unsigned int d = 0;
+        for (unsigned int p = 0; p < planes; p++) {
+            d += absDiff(img[p][x * imgStride], tpl[p][x * tplStride]);
+        }
+        
+        miss += d > tolerance;
+        sum += d;
+        max = (d > max) ? d : max;
+    }
+    
+    stats->miss += miss;
+    stats->sum += sum;
+    stats->max = max;
+}
+
+unsigned int columnMiss(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit) {
+    unsigned int miss = 0;
+    
+    for (unsigned int y = 0; y < n && miss <= limit; y++) {
+        miss += absDiff(img[y], tpl[y]) > tolerance;
+    }
+    
+    return miss;
+}
+
+#ifdef KERNEL_X86
+
+enum {
+    ISA_SCALAR,
+    ISA_SSE2,
+    ISA_AVX2,
+    ISA_AVX512BW
+};
+
+static void cpuid(unsigned int leaf, unsigned int subleaf, unsigned int *regs) {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuidex(info, (int) leaf, (int) subleaf);
+    for (int i = 0; i < 4; i++) {
+        regs[i] = (unsigned int) info[i];
+    }
+#else
+    if (leaf > __get_cpuid_max(leaf & 0x80000000, 0)) {
+        regs[0] = regs[1] = regs[2] = regs[3] = 0;
+        return;
+    }
+    
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// register state the OS saves on context switch, XCR0
+static unsigned long long xgetbv() {
+#ifdef _MSC_VER
+    return _xgetbv(0);
+#else
+    unsigned int eax, edx;
+    __asm__ __volatile__ ("xgetbv" : "=a" (eax), "=d" (edx) : "c" (0));
+    return ((unsigned long long) edx << 32) | eax;
+#endif
+}
+
+static int detectIsa() {
+    unsigned int regs[4];
+    
+    cpuid(0, 0, regs);
+    const unsigned int maxLeaf = regs[0];
+    
+    cpuid(1, 0, regs);
+    const bool sse2 = (regs[3] & (1u << 26)) != 0;
+    const bool osxsave = (regs[2] & (1u << 27)) != 0;
+    const bool avx = (regs[2] & (1u << 28)) != 0;
+    
+    if ( ! sse2) {
+        return ISA_SCALAR;
+    }
+    
+    if ( ! osxsave || ! avx || maxLeaf < 7) {
+        return ISA_SSE2;
+    }
+    
+    const unsigned long long xcr0 = xgetbv();
+    
+    cpuid(7, 0, regs);
+    const bool avx2 = (regs[1] & (1u << 5)) != 0;
+    const bool avx512f = (regs[1] & (1u << 16)) != 0;
+    const bool avx512bw = (regs[1] & (1u << 30)) != 0;
+    
+    // XMM, YMM and opmask, ZMM_Hi256, Hi16_ZMM state
+    if (avx512f && avx512bw && (xcr0 & 0xe6) == 0xe6) {
+        return ISA_AVX512BW;
+    }
+    
+    if (avx2 && (xcr0 & 0x06) == 0x06) {
+        return ISA_AVX2;
+    }
+    
+    return ISA_SSE2;
+}
+
+const char *selectKernel(const char *isa) {
+    int best = detectIsa();
+    
+    if (isa && ! strcmp(isa, "scalar")) {
+        best = ISA_SCALAR;
+    } else if (isa && ! strcmp(isa, "sse2") && best > ISA_SSE2) {
+        best = ISA_SSE2;
+    } else if (isa && ! strcmp(isa, "avx2") && best > ISA_AVX2) {
+        best = ISA_AVX2;
+    }
+    
+    switch (best) {
+        case ISA_AVX512BW:
+            kernelRowDiff = rowDiffAVX512BW;
+            kernelColumnMiss = columnMissAVX512BW;
+            return "avx512bw";
+        case ISA_AVX2:
+            kernelRowDiff = rowDiffAVX2;
+            kernelColumnMiss = columnMissAVX2;
+            return "avx2";
+        case ISA_SSE2:
+            kernelRowDiff = rowDiffSSE2;
+            kernelColumnMiss = columnMissSSE2;
+            return "sse2";
+        default:
+            kernelRowDiff = rowDiff;
+            kernelColumnMiss = columnMiss;
+            return "scalar";
+    }
+}
+
+#else
+
+const char *selectKernel(const char *isa) {
+    (void) isa;
+    kernelRowDiff = rowDiff;
+    kernelColumnMiss = columnMiss;
+    return "scalar";
+}
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#if defined(__i386__) || defined(__x86_64__) || defined(_M_IX86) || defined(_M_X64)
+#define KERNEL_X86
+#endif
+
+// `sum` is wide enough for the differences of a whole large template, which
+// overflow 32 bits once the template has more than about 5.6M pixels
+typedef struct {
+    unsigned int miss;
+    unsigned long long sum;
+    unsigned int max;
+} DiffStats;
+
+// Sums channel differences of `n` pixels per pixel and accumulates misses,
+// sum and max of those sums, `planes` is 1 for K and 3 for RGB
+typedef void (*RowDiff)(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats);
+
+void rowDiff(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats);
+
+// Counts samples of two contiguous runs of `n` bytes that differ by more than
+// `tolerance`, stops once misses exceed `limit` and returns the count so far
+typedef unsigned int (*ColumnMiss)(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit);
+
+unsigned int columnMiss(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit);
+
+#ifdef KERNEL_X86
+void rowDiffSSE2(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats);
+void rowDiffAVX2(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats);
+void rowDiffAVX512BW(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats);
+unsigned int columnMissSSE2(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit);
+unsigned int columnMissAVX2(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit);
+unsigned int columnMissAVX512BW(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit);
+#endif
+
+// kernels for the host CPU, scalar until selectKernel() is called
+extern RowDiff kernelRowDiff;
+extern ColumnMiss kernelColumnMiss;
+
+// Picks the widest instruction set supported by the CPU and OS, `isa` caps
+// the choice ("scalar", "sse2", "avx2", "avx512bw") and may be NULL,
+// returns the name of the selected kernel
+const char *selectKernel(const char *isa);
+
+// helpers are static so that copies compiled with wider instruction sets
+// in the ISA specific units are never shared with baseline code
+
+static inline unsigned char subSat(unsigned char a, unsigned char b) {
+    return (a > b) ? a - b : 0;
+}
+
+static inline unsigned char absDiff(unsigned char a, unsigned char b) {
+    // one of the saturated differences is always zero
+    return subSat(a, b) | subSat(b, a);
+}
+
+static inline unsigned int popcount(unsigned int v) {
+#if defined(__GNUC__)
+    return (unsigned int) __builtin_popcount(v);
+#else
+    v = v - ((v >> 1) & 0x55555555);
+    v = (v & 0x33333333) + ((v >> 2) & 0x33333333);
+    return (((v + (v >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#endif
+}
+
+// Scalar rowDiff() over pixels [x, n) of a row, finishes what vector
+// kernels leave over at the row end
+static inline void rowDiffTail(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int x, unsigned int tolerance, DiffStats *stats) {
+    const unsigned char *imgTail[3];
+    const unsigned char *tplTail[3];
+    
+    if (x >= n) {
+        return;
+    }
+    
+    for (unsigned int p = 0; p < planes; p++) {
+        imgTail[p] = img[p] + x * imgStride;
+        tplTail[p] = tpl[p] + x * tplStride;
+    }
+    
+    rowDiff(imgTail, imgStride, tplTail, tplStride, planes, n - x, tolerance, stats);
+}
+
+// Bit k is set when byte offset `phase + k` of a row holds the first sample
+// of a pixel, vector kernels use it to drop lanes that straddle pixels
+static inline unsigned long long laneMask(unsigned int stride, unsigned int phase) {
+    static const unsigned long long pattern[] = {
+        0ULL,
+        0xffffffffffffffffULL,
+        0x5555555555555555ULL,
+        0x9249249249249249ULL,
+        0x1111111111111111ULL
+    };
+    
+    return pattern[stride] << ((stride - phase) % stride);
+}
+
+#endif
@@ -0,0 +1,106 @@
+#include "kernel.h"
+
+#ifdef KERNEL_X86
+
+#include <immintrin.h>
+
+void rowDiffAVX2(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats) {
+    const unsigned int stride = imgStride;
+    const unsigned int span = (n - 1) * stride + 1;
+    
+    // vector loop walks bytes of both rows in lockstep
+    if (imgStride != tplStride || n == 0 || span < 32) {
+        rowDiffSSE2(img, imgStride, tpl, tplStride, planes, n, tolerance, stats);
+        return;
+    }
+    
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i ones = _mm256_set1_epi16(1);
+    const __m256i bits = _mm256_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128,
+        256, 512, 1024, 2048, 4096, 8192, 16384, (short) 32768);
+    const __m256i tol = _mm256_set1_epi16((short) (tolerance < 0x7fff ? tolerance : 0x7fff));
+    
+    __m256i valid[4][2];
+    for (unsigned int phase = 0; phase < stride; phase++) {
+        const unsigned int mask = (unsigned int) laneMask(stride, phase);
+        const __m256i lo = _mm256_set1_epi16((short) (mask & 0xffff));
+        const __m256i hi = _mm256_set1_epi16((short) (mask >> 16));
+        valid[phase][0] = _mm256_cmpeq_epi16(_mm256_and_si256(lo, bits), bits);
+        valid[phase][1] = _mm256_cmpeq_epi16(_mm256_and_si256(hi, bits), bits);
+    }
+    
+    __m256i sum = zero;
+    __m256i max = zero;
+    unsigned int miss = 0;
+    unsigned int phase = 0;
+    unsigned int j = 0;
+    
+    for (; j + 32 <= span; j += 32) {
+        __m256i lo = zero;
+        __m256i hi = zero;
+        
+        for (unsigned int p = 0; p < planes; p++) {
+            const __m256i a = _mm256_loadu_si256((const __m256i *) (img[p] + j));
+            const __m256i b = _mm256_loadu_si256((const __m256i *) (tpl[p] + j));
+            const __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+            lo = _mm256_add_epi16(lo, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(d)));
+            hi = _mm256_add_epi16(hi, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(d, 1)));
+        }
+        
+        lo = _mm256_and_si256(lo, valid[phase][0]);
+        hi = _mm256_and_si256(hi, valid[phase][1]);
+        
+        // two mask bits per 16-bit lane
+        miss += popcount((unsigned int) _mm256_movemask_epi8(_mm256_cmpgt_epi16(lo, tol)));
+        miss += popcount((unsigned int) _mm256_movemask_epi8(_mm256_cmpgt_epi16(hi, tol)));
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(_mm256_add_epi16(lo, hi), ones));
+        max = _mm256_max_epu16(max, _mm256_max_epu16(lo, hi));
+        
+        phase = (phase + 32) % stride;
+    }
+    
+    unsigned int sums[8];
+    unsigned short maxs[16];
+    _mm256_storeu_si256((__m256i *) sums, sum);
+    _mm256_storeu_si256((__m256i *) maxs, max);
+    
+    stats->miss += miss / 2;
+    for (unsigned int i = 0; i < 8; i++) {
+        stats->sum += sums[i];
+    }
+    for (unsigned int i = 0; i < 16; i++) {
+        stats->max = (maxs[i] > stats->max) ? maxs[i] : stats->max;
+    }
+    
+    rowDiffTail(img, imgStride, tpl, tplStride, planes, n, (j + stride - 1) / stride, tolerance, stats);
+}
+
+unsigned int columnMissAVX2(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit) {
+    if (tolerance >= 255 || n < 32) {
+        return columnMissSSE2(img, tpl, n, tolerance, limit);
+    }
+    
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i tol = _mm256_set1_epi8((char) tolerance);
+    unsigned int miss = 0;
+    unsigned int j = 0;
+    
+    for (; j + 32 <= n; j += 32) {
+        const __m256i a = _mm256_loadu_si256((const __m256i *) (img + j));
+        const __m256i b = _mm256_loadu_si256((const __m256i *) (tpl + j));
+        const __m256i d = _mm256_or_si256(_mm256_subs_epu8(a, b), _mm256_subs_epu8(b, a));
+        
+        miss += 32 - popcount((unsigned int) _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_subs_epu8(d, tol), zero)));
+        
+        if (miss > limit) {
+            return miss;
+        }
+    }
+    
+    return miss + columnMissSSE2(img + j, tpl + j, n - j, tolerance, limit - miss);
+}
+
+#endif
@@ -0,0 +1,101 @@
+#include "kernel.h"
+
+#ifdef KERNEL_X86
+
+#include <immintrin.h>
+
+void rowDiffAVX512BW(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats) {
+    const unsigned int stride = imgStride;
+    const unsigned int span = (n - 1) * stride + 1;
+    
+    // vector loop walks bytes of both rows in lockstep
+    if (imgStride != tplStride || n == 0 || span < 64) {
+        rowDiffAVX2(img, imgStride, tpl, tplStride, planes, n, tolerance, stats);
+        return;
+    }
+    
+    const __m512i zero = _mm512_setzero_si512();
+    const __m512i ones = _mm512_set1_epi16(1);
+    const __m512i tol = _mm512_set1_epi16((short) (tolerance < 0xffff ? tolerance : 0xffff));
+    
+    __mmask32 valid[4][2];
+    for (unsigned int phase = 0; phase < stride; phase++) {
+        const unsigned long long mask = laneMask(stride, phase);
+        valid[phase][0] = (__mmask32) (mask & 0xffffffff);
+        valid[phase][1] = (__mmask32) (mask >> 32);
+    }
+    
+    __m512i sum = zero;
+    __m512i max = zero;
+    unsigned int miss = 0;
+    unsigned int phase = 0;
+    unsigned int j = 0;
+    
+    for (; j + 64 <= span; j += 64) {
+        __m512i lo = zero;
+        __m512i hi = zero;
+        
+        for (unsigned int p = 0; p < planes; p++) {
+            const __m512i a = _mm512_loadu_si512((const void *) (img[p] + j));
+            const __m512i b = _mm512_loadu_si512((const void *) (tpl[p] + j));
+            const __m512i d = _mm512_or_si512(_mm512_subs_epu8(a, b), _mm512_subs_epu8(b, a));
+            lo = _mm512_add_epi16(lo, _mm512_cvtepu8_epi16(_mm512_castsi512_si256(d)));
+            hi = _mm512_add_epi16(hi, _mm512_cvtepu8_epi16(_mm512_extracti64x4_epi64(d, 1)));
+        }
+        
+        lo = _mm512_maskz_mov_epi16(valid[phase][0], lo);
+        hi = _mm512_maskz_mov_epi16(valid[phase][1], hi);
+        
+        miss += popcount((unsigned int) _mm512_cmpgt_epu16_mask(lo, tol));
+        miss += popcount((unsigned int) _mm512_cmpgt_epu16_mask(hi, tol));
+        sum = _mm512_add_epi32(sum, _mm512_madd_epi16(_mm512_add_epi16(lo, hi), ones));
+        max = _mm512_max_epu16(max, _mm512_max_epu16(lo, hi));
+        
+        phase = (phase + 64) % stride;
+    }
+    
+    unsigned int sums[16];
+    unsigned short maxs[32];
+    _mm512_storeu_si512((void *) sums, sum);
+    _mm512_storeu_si512((void *) maxs, max);
+    
+    stats->miss += miss;
+    for (unsigned int i = 0; i < 16; i++) {
+        stats->sum += sums[i];
+    }
+    for (unsigned int i = 0; i < 32; i++) {
+        stats->max = (maxs[i] > stats->max) ? maxs[i] : stats->max;
+    }
+    
+    rowDiffTail(img, imgStride, tpl, tplStride, planes, n, (j + stride - 1) / stride, tolerance, stats);
+}
+
+unsigned int columnMissAVX512BW(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit) {
+    if (n < 64) {
+        return columnMissAVX2(img, tpl, n, tolerance, limit);
+    }
+    
+    const __m512i tol = _mm512_set1_epi8((char) (tolerance < 0xff ? tolerance : 0xff));
+    unsigned int miss = 0;
+    unsigned int j = 0;
+    
+    for (; j + 64 <= n; j += 64) {
+        const __m512i a = _mm512_loadu_si512((const void *) (img + j));
+        const __m512i b = _mm512_loadu_si512((const void *) (tpl + j));
+        const __m512i d = _mm512_or_si512(_mm512_subs_epu8(a, b), _mm512_subs_epu8(b, a));
+        const __mmask64 over = _mm512_cmpgt_epu8_mask(d, tol);
+        
+        miss += popcount((unsigned int) (over & 0xffffffff)) + popcount((unsigned int) (over >> 32));
+        
+        if (miss > limit) {
+            return miss;
+        }
+    }
+    
+    return miss + columnMissAVX2(img + j, tpl + j, n - j, tolerance, limit - miss);
+}
+
+#endif
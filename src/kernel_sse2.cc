@@ -0,0 +1,104 @@
+#include "kernel.h"
+
+#ifdef KERNEL_X86
+
+#include <emmintrin.h>
+
+void rowDiffSSE2(const unsigned char *const *img, unsigned int imgStride,
+    const unsigned char *const *tpl, unsigned int tplStride,
+    unsigned int planes, unsigned int n, unsigned int tolerance, DiffStats *stats) {
+    const unsigned int stride = imgStride;
+    const unsigned int span = (n - 1) * stride + 1;
+    
+    // vector loop walks bytes of both rows in lockstep
+    if (imgStride != tplStride || n == 0 || span < 16) {
+        rowDiff(img, imgStride, tpl, tplStride, planes, n, tolerance, stats);
+        return;
+    }
+    
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i ones = _mm_set1_epi16(1);
+    const __m128i bits = _mm_setr_epi16(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m128i tol = _mm_set1_epi16((short) (tolerance < 0x7fff ? tolerance : 0x7fff));
+    
+    __m128i valid[4][2];
+    for (unsigned int phase = 0; phase < stride; phase++) {
+        const unsigned int mask = (unsigned int) laneMask(stride, phase);
+        const __m128i lo = _mm_set1_epi16((short) (mask & 0xff));
+        const __m128i hi = _mm_set1_epi16((short) ((mask >> 8) & 0xff));
+        valid[phase][0] = _mm_cmpeq_epi16(_mm_and_si128(lo, bits), bits);
+        valid[phase][1] = _mm_cmpeq_epi16(_mm_and_si128(hi, bits), bits);
+    }
+    
+    __m128i sum = zero;
+    __m128i max = zero;
+    unsigned int miss = 0;
+    unsigned int phase = 0;
+    unsigned int j = 0;
+    
+    for (; j + 16 <= span; j += 16) {
+        __m128i lo = zero;
+        __m128i hi = zero;
+        
+        for (unsigned int p = 0; p < planes; p++) {
+            const __m128i a = _mm_loadu_si128((const __m128i *) (img[p] + j));
+            const __m128i b = _mm_loadu_si128((const __m128i *) (tpl[p] + j));
+            const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+            lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(d, zero));
+            hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(d, zero));
+        }
+        
+        lo = _mm_and_si128(lo, valid[phase][0]);
+        hi = _mm_and_si128(hi, valid[phase][1]);
+        
+        const __m128i over = _mm_packs_epi16(_mm_cmpgt_epi16(lo, tol), _mm_cmpgt_epi16(hi, tol));
+        miss += popcount((unsigned int) _mm_movemask_epi8(over));
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(_mm_add_epi16(lo, hi), ones));
+        max = _mm_max_epi16(max, _mm_max_epi16(lo, hi));
+        
+        phase = (phase + 16) % stride;
+    }
+    
+    unsigned int sums[4];
+    unsigned short maxs[8];
+    _mm_storeu_si128((__m128i *) sums, sum);
+    _mm_storeu_si128((__m128i *) maxs, max);
+    
+    stats->miss += miss;
+    stats->sum += (unsigned long long) sums[0] + sums[1] + sums[2] + sums[3];
+    for (unsigned int i = 0; i < 8; i++) {
+        stats->max = (maxs[i] > stats->max) ? maxs[i] : stats->max;
+    }
+    
+    rowDiffTail(img, imgStride, tpl, tplStride, planes, n, (j + stride - 1) / stride, tolerance, stats);
+}
+
+unsigned int columnMissSSE2(const unsigned char *img, const unsigned char *tpl,
+    unsigned int n, unsigned int tolerance, unsigned int limit) {
+    // no two bytes differ by more
+    if (tolerance >= 255) {
+        return 0;
+    }
+    
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i tol = _mm_set1_epi8((char) tolerance);
+    unsigned int miss = 0;
+    unsigned int j = 0;
+    
+    for (; j + 16 <= n; j += 16) {
+        const __m128i a = _mm_loadu_si128((const __m128i *) (img + j));
+        const __m128i b = _mm_loadu_si128((const __m128i *) (tpl + j));
+        const __m128i d = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+        
+        // differences within tolerance saturate to zero
+        miss += 16 - popcount((unsigned int) _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(d, tol), zero)));
+        
+        if (miss > limit) {
+            return miss;
+        }
+    }
+    
+    return miss + columnMiss(img + j, tpl + j, n - j, tolerance, limit - miss);
+}
+
+#endif
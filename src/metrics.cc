@@ -0,0 +1,117 @@
+#include <cstdio>
+#include <cstring>
+
+#include "metrics.h"
+
+Metrics metrics;
+
+const double Metrics::bounds[Metrics::BUCKETS] = { 0.0001, 0.0005, 0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1, 5 };
+
+Metrics::Metrics() : searchesStarted(0), searchesCompleted(0), searchesCancelled(0), searchesTimedOut(0),
+    pixelsScanned(0), bytesCopied(0) {
+    memset(&queueWait, 0, sizeof(queueWait));
+    memset(&busy, 0, sizeof(busy));
+    uv_mutex_init(&mutex);
+}
+
+Metrics::~Metrics() {
+    uv_mutex_destroy(&mutex);
+}
+
+void Metrics::started() {
+    uv_mutex_lock(&mutex);
+    searchesStarted++;
+    uv_mutex_unlock(&mutex);
+}
+
+void Metrics::finished(StopReason reason, uint64_t pixels) {
+    uv_mutex_lock(&mutex);
+    if (reason == STOP_CANCELLED) {
+        searchesCancelled++;
+    } else if (reason == STOP_DEADLINE) {
+        searchesTimedOut++;
+    } else {
+        searchesCompleted++;
+    }
+    pixelsScanned += pixels;
+    uv_mutex_unlock(&mutex);
+}
+
+void Metrics::copied(uint64_t bytes) {
+    uv_mutex_lock(&mutex);
+    bytesCopied += bytes;
+    uv_mutex_unlock(&mutex);
+}
+
+void Metrics::waited(uint64_t ns) {
+    uv_mutex_lock(&mutex);
+    observe(queueWait, ns);
+    uv_mutex_unlock(&mutex);
+}
+
+void Metrics::worked(uint64_t ns) {
+    uv_mutex_lock(&mutex);
+    observe(busy, ns);
+    uv_mutex_unlock(&mutex);
+}
+
+// called with mutex held, counts are kept per bucket and summed up when
+// rendered
+void Metrics::observe(Histogram &histogram, uint64_t ns) {
+    unsigned int bucket = 0;
+    
+    while (bucket < BUCKETS && (double) ns / 1e9 > bounds[bucket]) {
+        bucket++;
+    }
+    
+    histogram.counts[bucket]++;
+    histogram.count++;
+    histogram.sumNs += ns;
+}
+
+static void counter(std::string &out, const char *name, const char *help, uint64_t value) {
+    char line[64];
+    
+    snprintf(line, sizeof(line), "%llu\n", (unsigned long long) value);
+    out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " counter\n" + name + " " + line;
+}
+
+void Metrics::render(std::string &out, const char *name, const char *help, const Histogram &histogram) {
+    char line[160];
+    uint64_t cumulative = 0;
+    
+    out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " histogram\n";
+    
+    for (unsigned int i = 0; i <= BUCKETS; i++) {
+        cumulative += histogram.counts[i];
+        
+        if (i < BUCKETS) {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"%g\"} %llu\n", name, bounds[i], (unsigned long long) cumulative);
+        } else {
+            snprintf(line, sizeof(line), "%s_bucket{le=\"+Inf\"} %llu\n", name, (unsigned long long) cumulative);
+        }
+        
+        out += line;
+    }
+    
+    snprintf(line, sizeof(line), "%s_sum %.9f\n%s_count %llu\n", name, (double) histogram.sumNs / 1e9,
+        name, (unsigned long long) histogram.count);
+    out += line;
+}
+
+std::string Metrics::prometheus() {
+    std::string out;
+    
+    uv_mutex_lock(&mutex);
+    counter(out, "imagesearch_searches_started_total", "Searches started.", searchesStarted);
+    counter(out, "imagesearch_searches_completed_total", "Searches that ran to the end.", searchesCompleted);
+    counter(out, "imagesearch_searches_cancelled_total", "Searches cut short by cancellation.", searchesCancelled);
+    counter(out, "imagesearch_searches_timed_out_total", "Searches cut short by their deadline.", searchesTimedOut);
+    counter(out, "imagesearch_pixels_scanned_total", "Candidate positions scanned by finished searches, at every pyramid level.", pixelsScanned);
+    counter(out, "imagesearch_copied_bytes_total", "Pixel bytes copied into prepared images and templates.", bytesCopied);
+    render(out, "imagesearch_queue_wait_seconds", "Time searches waited for a thread.", queueWait);
+    render(out, "imagesearch_worker_busy_seconds", "Time threads spent running a search.", busy);
+    uv_mutex_unlock(&mutex);
+    
+    return out;
+}
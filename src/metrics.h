@@ -0,0 +1,58 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <string>
+
+#include <uv.h>
+
+#include "engine.h"
+
+// Process-wide counters of searches, updated from the loop thread and search
+// threads alike, rendered in Prometheus text format
+class Metrics {
+public:
+    Metrics();
+    ~Metrics();
+    
+    void started();
+    // search called back, `pixels` candidate positions it scanned
+    void finished(StopReason reason, uint64_t pixels);
+    void copied(uint64_t bytes);
+    // time between queueing a search and a thread taking it up
+    void waited(uint64_t ns);
+    // time a thread spent running a search
+    void worked(uint64_t ns);
+    
+    std::string prometheus();
+
+private:
+    // upper bounds of histogram buckets in seconds, +Inf comes last
+    static const unsigned int BUCKETS = 10;
+    static const double bounds[BUCKETS];
+    
+    typedef struct {
+        uint64_t counts[BUCKETS + 1];
+        uint64_t count;
+        uint64_t sumNs;
+    } Histogram;
+    
+    static void observe(Histogram &histogram, uint64_t ns);
+    static void render(std::string &out, const char *name, const char *help, const Histogram &histogram);
+    
+    uint64_t searchesStarted;
+    uint64_t searchesCompleted;
+    uint64_t searchesCancelled;
+    uint64_t searchesTimedOut;
+    uint64_t pixelsScanned;
+    uint64_t bytesCopied;
+    Histogram queueWait;
+    Histogram busy;
+    uv_mutex_t mutex;
+    
+    Metrics(const Metrics &);
+    Metrics &operator=(const Metrics &);
+};
+
+extern Metrics metrics;
+
+#endif
@@ -0,0 +1,219 @@
+#include "pool.h"
+
+#ifdef IMAGESEARCH_BENCH
+Pool::Pool(unsigned int size) : threads(size), stopping(false) {
+    uv_mutex_init(&mutex);
+    uv_cond_init(&ready);
+    
+    for (unsigned int i = 0; i < size; i++) {
+        uv_thread_create(&threads[i], work, this);
+    }
+}
+#else
+static void closed(uv_handle_t *handle) {
+    delete (uv_async_t*) handle;
+}
+
+Pool::Pool(unsigned int size, uv_loop_t *loop) : threads(size), stopping(false), async(NULL), pending(0) {
+    uv_mutex_init(&mutex);
+    uv_cond_init(&ready);
+    
+    // idle pool does not keep the loop alive
+    if (loop) {
+        async = new uv_async_t;
+        uv_async_init(loop, async, complete);
+        uv_unref((uv_handle_t*) async);
+        async->data = this;
+    }
+    
+    for (unsigned int i = 0; i < size; i++) {
+        uv_thread_create(&threads[i], work, this);
+    }
+}
+#endif
+
+Pool::~Pool() {
+    uv_mutex_lock(&mutex);
+    stopping = true;
+    uv_cond_broadcast(&ready);
+    uv_mutex_unlock(&mutex);
+    
+    for (unsigned int i = 0; i < threads.size(); i++) {
+        uv_thread_join(&threads[i]);
+    }
+
+#ifndef IMAGESEARCH_BENCH
+    if (async) {
+        uv_close((uv_handle_t*) async, closed);
+    }
+#endif
+
+    uv_cond_destroy(&ready);
+    uv_mutex_destroy(&mutex);
+}
+
+unsigned int Pool::size() const {
+    return (unsigned int) threads.size();
+}
+
+void Pool::run(Task **tasks, unsigned int count, unsigned int concurrency) {
+    Group group;
+    group.pending = count;
+    group.running = 0;
+    group.concurrency = concurrency;
+    uv_cond_init(&group.done);
+    
+    uv_mutex_lock(&mutex);
+    group.tiles.assign(tasks, tasks + count);
+    groups.push_back(&group);
+    uv_cond_broadcast(&ready);
+    
+    while (group.pending > 0) {
+        if (group.tiles.empty() || (concurrency > 0 && group.running >= concurrency)) {
+            uv_cond_wait(&group.done, &mutex);
+            continue;
+        }
+        
+        // own tiles in reverse, stealing threads take them in order
+        Task *tile = group.tiles.back();
+        group.tiles.pop_back();
+        group.running++;
+        
+        if (group.tiles.empty()) {
+            groups.remove(&group);
+        }
+        
+        uv_mutex_unlock(&mutex);
+        tile->run();
+        uv_mutex_lock(&mutex);
+        
+        finish(&group);
+    }
+    uv_mutex_unlock(&mutex);
+    
+    uv_cond_destroy(&group.done);
+}
+
+#ifndef IMAGESEARCH_BENCH
+void Pool::queue(uv_work_t *request, uv_work_cb work, uv_after_work_cb after) {
+    if (pending++ == 0) {
+        uv_ref((uv_handle_t*) async);
+    }
+    
+    Job job = { request, work, after };
+    
+    uv_mutex_lock(&mutex);
+    jobs.push_back(job);
+    uv_cond_signal(&ready);
+    uv_mutex_unlock(&mutex);
+}
+#endif
+
+// called with mutex held, oldest group with a tile to spare
+Pool::Group *Pool::stealable() {
+    for (std::list<Group*>::iterator it = groups.begin(); it != groups.end(); it++) {
+        if ((*it)->concurrency == 0 || (*it)->running < (*it)->concurrency) {
+            return *it;
+        }
+    }
+    
+    return NULL;
+}
+
+// called with mutex held
+void Pool::finish(Group *group) {
+    group->running--;
+    group->pending--;
+    
+    // waiting thread checks whether all tiles are done or one more may run
+    uv_cond_signal(&group->done);
+    
+    // concurrency limit may have held back tiles
+    if ( ! group->tiles.empty()) {
+        uv_cond_signal(&ready);
+    }
+}
+
+void Pool::work(void *arg) {
+    Pool *pool = static_cast<Pool*>(arg);
+    
+    uv_mutex_lock(&pool->mutex);
+    for (;;) {
+        Group *group = NULL;
+
+#ifdef IMAGESEARCH_BENCH
+        while ( ! pool->stopping && ! (group = pool->stealable())) {
+#else
+        while ( ! pool->stopping && pool->jobs.empty() && ! (group = pool->stealable())) {
+#endif
+            uv_cond_wait(&pool->ready, &pool->mutex);
+        }
+        
+        if (pool->stopping) {
+            break;
+        }
+
+#ifndef IMAGESEARCH_BENCH
+        if ( ! pool->jobs.empty()) {
+            Job job = pool->jobs.front();
+            pool->jobs.pop_front();
+            
+            uv_mutex_unlock(&pool->mutex);
+            job.work(job.request);
+            uv_mutex_lock(&pool->mutex);
+            
+            pool->done.push_back(job);
+            uv_async_send(pool->async);
+            continue;
+        }
+#endif
+
+        Task *tile = group->tiles.front();
+        group->tiles.pop_front();
+        group->running++;
+        
+        if (group->tiles.empty()) {
+            pool->groups.remove(group);
+        }
+        
+        uv_mutex_unlock(&pool->mutex);
+        tile->run();
+        uv_mutex_lock(&pool->mutex);
+        
+        pool->finish(group);
+    }
+    uv_mutex_unlock(&pool->mutex);
+}
+
+#ifndef IMAGESEARCH_BENCH
+// sends may be coalesced, so every finished job is called back
+void Pool::complete(uv_async_t *async, int status) {
+    Pool *pool = static_cast<Pool*>(async->data);
+    std::deque<Job> finished;
+    
+    uv_mutex_lock(&pool->mutex);
+    finished.swap(pool->done);
+    uv_mutex_unlock(&pool->mutex);
+    
+    for (std::deque<Job>::iterator it = finished.begin(); it != finished.end(); it++) {
+        it->after(it->request, 0);
+        
+        if (--pool->pending == 0) {
+            uv_unref((uv_handle_t*) pool->async);
+        }
+    }
+}
+
+unsigned int cpuCount() {
+    uv_cpu_info_t *infos;
+    int count = 0;
+    
+    uv_err_t err = uv_cpu_info(&infos, &count);
+    if (err.code != UV_OK) {
+        return 1;
+    }
+    uv_free_cpu_info(infos, count);
+    
+    return count > 0 ? (unsigned int) count : 1;
+}
+#endif
@@ -0,0 +1,90 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <deque>
+#include <list>
+#include <vector>
+
+#include "threads.h"
+
+class Task {
+public:
+    virtual ~Task() {}
+    virtual void run() = 0;
+};
+
+// Threads running whole searches as jobs, separate from the libuv pool that
+// file system, DNS and zlib requests share, and tiles of those searches.
+// Each search splitting into tiles keeps them in a deque of its own, its
+// thread takes tiles from the back and idle threads steal them from the
+// front. Waiting jobs are taken before stolen tiles, so that small searches
+// do not wait for large ones. Lives as long as the process. The benchmark
+// build (IMAGESEARCH_BENCH) has no event loop and runs tiles only.
+class Pool {
+public:
+#ifdef IMAGESEARCH_BENCH
+    explicit Pool(unsigned int size);
+#else
+    // jobs are called back on `loop`, a pool without loop runs tiles only
+    explicit Pool(unsigned int size, uv_loop_t *loop = NULL);
+#endif
+    ~Pool();
+    
+    // Queues tiles and waits for all of them to finish, the calling thread
+    // runs tiles too while it waits. At most `concurrency` of them run at
+    // once, 0 for no limit.
+    void run(Task **tasks, unsigned int count, unsigned int concurrency = 0);
+
+#ifndef IMAGESEARCH_BENCH
+    // same contract as uv_queue_work, called on the loop thread
+    void queue(uv_work_t *request, uv_work_cb work, uv_after_work_cb after);
+#endif
+
+    unsigned int size() const;
+
+private:
+    typedef struct {
+        std::deque<Task*> tiles;
+        unsigned int pending;
+        unsigned int running;
+        unsigned int concurrency;
+        uv_cond_t done;
+    } Group;
+    
+    static void work(void *arg);
+    Group *stealable();
+    void finish(Group *group);
+    
+    // groups with tiles left, oldest first
+    std::list<Group*> groups;
+    std::vector<uv_thread_t> threads;
+    uv_mutex_t mutex;
+    uv_cond_t ready;
+    bool stopping;
+
+#ifndef IMAGESEARCH_BENCH
+    typedef struct {
+        uv_work_t *request;
+        uv_work_cb work;
+        uv_after_work_cb after;
+    } Job;
+    
+    static void complete(uv_async_t *async, int status);
+    
+    std::deque<Job> jobs;
+    std::deque<Job> done;
+    uv_async_t *async;
+    // jobs not yet called back, touched on the loop thread only
+    unsigned int pending;
+#endif
+
+    Pool(const Pool &);
+    Pool &operator=(const Pool &);
+};
+
+#ifndef IMAGESEARCH_BENCH
+// number of logical CPUs
+unsigned int cpuCount();
+#endif
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef PROBES_H
+#define PROBES_H
+
+// USDT probes of searches and their phases, compiled in with the `usdt`
+// build variable and listed by `readelf -n search.node`. Searches are
+// identified by the address of their baton, phases are "unwrap", "search",
+// "focus" and "marshal", given with their uv_hrtime() start and duration in
+// nanoseconds. Searches are done as "completed", "cancelled" or "timed_out".
+#ifdef IMAGESEARCH_USDT
+
+#include <sys/sdt.h>
+
+#define PROBE_SEARCH_START(id, waitNs) DTRACE_PROBE2(imagesearch, search__start, id, waitNs)
+#define PROBE_SEARCH_DONE(id, matches, busyNs, reason) DTRACE_PROBE4(imagesearch, search__done, id, matches, busyNs, reason)
+#define PROBE_PHASE(id, phase, startNs, ns) DTRACE_PROBE4(imagesearch, phase, id, phase, startNs, ns)
+
+#else
+
+#define PROBE_SEARCH_START(id, waitNs) do {} while (0)
+#define PROBE_SEARCH_DONE(id, matches, busyNs, reason) do {} while (0)
+#define PROBE_PHASE(id, phase, startNs, ns) do {} while (0)
+
+#endif
+
+#endif
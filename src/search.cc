@@ -1,5 +1,8 @@
 #include <iostream>
+#include <cstring>
 #include <cmath>
+#include <cstdlib>
+#include <string>
 #include <vector>
 
 #include <uv.h>
@@ -9,377 +12,879 @@
 #include <Eigen/Dense>
 
 #include "search.h"
+#include "handle.h"
+#include "image.h"
+#include "metrics.h"
+#include "probes.h"
+#include "template.h"
 
 using namespace v8;
 
-Handle<Value> Search(const Arguments& args) {
-    HandleScope scope;
+// threads running searches and their tiles, started by the first search with
+// `searchPoolSize` threads or one per CPU
+static Pool *searchPool = NULL;
+static unsigned int searchPoolSize = 0;
+
+// searches collected for the next batch job and the timer ending its window
+static BatchBaton *pendingBatch = NULL;
+static uv_timer_t batchTimer;
+static bool batchTimerReady = false;
+
+// Unwraps typed array or buffer backing store, returns element count
+size_t unwrapBuffer(Handle<Value> value, void **data, ExternalArrayType *type) {
+    if ( ! value->IsObject()) {
+        return 0;
+    }
+    
+    Handle<Object> buffer = Handle<Object>::Cast(value);
+    
+    if ( ! buffer->HasIndexedPropertiesInExternalArrayData()) {
+        return 0;
+    }
+    
+    *data = buffer->GetIndexedPropertiesExternalArrayData();
+    *type = buffer->GetIndexedPropertiesExternalArrayDataType();
+    
+    return (size_t) buffer->GetIndexedPropertiesExternalArrayDataLength();
+}
+
+// Points matrix channels at planar (one array per channel) or interleaved
+// (single buffer of K, KA, RGB or RGBA pixels) data without copying it,
+// buffers are appended to `keep` to outlive the search
+bool unwrapData(Handle<Object> data, Cargo *m, Handle<Array> keep) {
+    void *planes[4] = { 0, 0, 0, 0 };
+    size_t length[4] = { 0, 0, 0, 0 };
+    ExternalArrayType type[4];
+    
+    const bool interleaved = data->HasIndexedPropertiesInExternalArrayData();
+    const unsigned int count = interleaved ? 1 : m->channels;
+    const size_t size = (size_t) m->rows * m->cols;
+    
+    for (unsigned int i = 0; i < count; i++) {
+        Handle<Value> plane = interleaved ? Handle<Value>(data) : data->Get(i);
+        length[i] = unwrapBuffer(plane, &planes[i], &type[i]);
+        
+        if ( ! planes[i] || type[i] != type[0] || length[i] != length[0]) {
+            return false;
+        }
+        
+        keep->Set(keep->Length(), plane);
+    }
+    
+    size_t sampleSize;
     
+    if (type[0] == kExternalFloatArray) {
+        m->type = PIXEL_FLOAT;
+        sampleSize = sizeof(float);
+    } else if (type[0] == kExternalUnsignedByteArray || type[0] == kExternalPixelArray) {
+        m->type = PIXEL_UINT8;
+        sampleSize = sizeof(unsigned char);
+    } else {
+        return false;
+    }
+    
+    if (interleaved) {
+        if (length[0] < size * m->channels) {
+            return false;
+        }
+        
+        m->stride = m->channels;
+        for (unsigned int i = 1; i < m->channels; i++) {
+            planes[i] = (char *) planes[0] + i * sampleSize;
+        }
+    } else {
+        if (length[0] < size) {
+            return false;
+        }
+        
+        m->stride = 1;
+    }
+    
+    assignPlanes(m, planes);
+    
+    return true;
+}
+
+// Unwraps a matrix object, `name` is used in error messages and buffers are
+// appended to `keep`. Returns error message on failure, empty string otherwise.
+std::string unwrapMatrix(Handle<Value> value, const std::string &name, Cargo *m, Handle<Array> keep) {
     Local<String> rows = String::New("rows");
     Local<String> cols = String::New("cols");
     Local<String> data = String::New("data");
     Local<String> channels = String::New("channels");
     
-    // unwrap arguments
-    Handle<Object> matrix1 = Handle<Object>::Cast(args[0]);
-    Handle<Object> matrix2 = Handle<Object>::Cast(args[1]);
+    // check for required matrix properties
+    if ( ! value->IsObject()) {
+        return "Bad argument '" + name + "'";
+    }
+    
+    Handle<Object> matrix = Handle<Object>::Cast(value);
+    
+    if ( ! matrix->Has(rows) || ! matrix->Has(cols) || ! matrix->Has(channels) || ! matrix->Has(data)) {
+        return "Bad argument '" + name + "'";
+    }
+    
+    m->rows = matrix->Get(rows)->Uint32Value();
+    m->cols = matrix->Get(cols)->Uint32Value();
+    m->channels = matrix->Get(channels)->Uint32Value();
+    m->pitch = 0;
+    
+    // channel count validation
+    if (m->channels < 1 || m->channels > 4) {
+        return "Bad number of channels";
+    }
+    
+    Handle<Object> mData = Handle<Object>::Cast(matrix->Get(data));
+    
+    // TODO: consider removal of channels property
+    // declared and actual channel count validation, interleaved data is
+    // a single buffer and carries all channels itself
+    if ( ! mData->IsObject() || ( ! mData->HasIndexedPropertiesInExternalArrayData() &&
+        m->channels != mData->Get(String::New("length"))->Uint32Value())) {
+        return "Bad argument '" + name + "'";
+    }
+    
+    if ( ! unwrapData(mData, m, keep)) {
+        return "Bad argument '" + name + ".data'";
+    }
+    
+    return "";
+}
+
+// Copies matrix pixels into `storage` and points the matrix at the copy,
+// layout is kept and rows are padded to a multiple of `alignment` bytes
+void copyPixels(Cargo *m, PixelStorage &storage, size_t alignment) {
+    const size_t sampleSize = (m->type == PIXEL_FLOAT) ? sizeof(float) : sizeof(unsigned char);
+    const size_t rowSize = (size_t) m->cols * m->stride * sampleSize;
+    const size_t pitch = (rowSize + alignment - 1) / alignment * alignment;
+    const size_t planeSize = pitch * m->rows;
+    // interleaved pixels are a single plane of all channels
+    const unsigned int count = (m->stride > 1) ? 1 : m->channels;
+    void *source[4] = { m->r, m->g, m->b, m->a };
+    void *planes[4] = { 0, 0, 0, 0 };
+    
+    if (m->channels < 3) {
+        source[0] = m->k;
+        source[1] = m->a;
+    }
+    
+    storage.assign(planeSize * count, 0);
+    unsigned char *base = &storage[0];
+    
+    for (unsigned int i = 0; i < count; i++) {
+        const unsigned char *from = static_cast<const unsigned char*>(source[i]);
+        unsigned char *to = base + i * planeSize;
+        
+        for (unsigned int y = 0; y < m->rows; y++) {
+            memcpy(to + y * pitch, from + y * rowSize, rowSize);
+        }
+    }
+    
+    for (unsigned int i = 0; i < m->channels; i++) {
+        planes[i] = (m->stride > 1) ? base + i * sampleSize : base + i * planeSize;
+    }
+    
+    assignPlanes(m, planes);
+    m->pitch = (unsigned int) (pitch / sampleSize);
+    
+    metrics.copied(storage.size());
+}
+
+// Points K or R, G, B channels and alpha at planes in pixel order
+void assignPlanes(Cargo *m, void **planes) {
+    m->k = m->r = m->g = m->b = m->a = 0;
+    
+    if (m->channels == 1 || m->channels == 2) {
+        m->k = planes[0];
+    } else {
+        m->r = planes[0];
+        m->g = planes[1];
+        m->b = planes[2];
+    }
+    
+    if (m->channels == 2) {
+        m->a = planes[1];
+    } else if (m->channels == 4) {
+        m->a = planes[3];
+    }
+}
+
+// Unwraps search options, threads are capped by the search pool size
+SearchOptions unwrapOptions(Handle<Object> options, unsigned int colorTolerance, unsigned int pixelTolerance) {
+    SearchOptions out = SearchOptions();
+    out.colorTolerance = colorTolerance;
+    out.pixelTolerance = pixelTolerance;
+    out.threads = options->Get(String::New("threads"))->Uint32Value();
+    out.prefilter = options->Get(String::New("prefilter"))->Uint32Value();
+    out.pyramid = options->Get(String::New("pyramid"))->Uint32Value();
+    out.fft = options->Get(String::New("fft"))->BooleanValue();
+    out.focus = options->Get(String::New("focus"))->BooleanValue();
+    out.maxResults = options->Get(String::New("maxResults"))->Uint32Value();
+    out.firstMatch = options->Get(String::New("firstMatch"))->BooleanValue();
+    out.mask = options->Get(String::New("mask"))->BooleanValue();
+    
+    if (out.threads > 1 && out.threads > pool()->size()) {
+        out.threads = pool()->size();
+    }
+    
+    return out;
+}
+
+// Unwraps image argument of a search, prepared image is taken as is
+std::string unwrapImage(Handle<Value> value, Cargo *m, Image **image, Handle<Array> keep) {
+    *image = Image::HasInstance(value) ? node::ObjectWrap::Unwrap<Image>(Handle<Object>::Cast(value)) : NULL;
+    
+    if (*image) {
+        *m = (*image)->cargo;
+        keep->Set(keep->Length(), value);
+        return "";
+    }
+    
+    return unwrapMatrix(value, "imgMatrix", m, keep);
+}
+
+// Unwraps template argument of a search, prepared template is taken as is,
+// and checks it against the image
+std::string unwrapTemplate(Handle<Value> value, const Cargo &m1, Cargo *m, TemplateObject **prepared, Handle<Array> keep) {
+    *prepared = TemplateObject::HasInstance(value) ? node::ObjectWrap::Unwrap<TemplateObject>(Handle<Object>::Cast(value)) : NULL;
+    
+    if (*prepared) {
+        *m = (*prepared)->cargo;
+        keep->Set(keep->Length(), value);
+    } else {
+        const std::string error = unwrapMatrix(value, "tplMatrix", m, keep);
+        
+        if ( ! error.empty()) {
+            return error;
+        }
+    }
+    
+    if (abs((int) m->channels - (int) m1.channels) > 1) {
+        return "Channel mismatch";
+    }
+    
+    if (m1.type != m->type) {
+        return "Data type mismatch";
+    }
+    
+    return "";
+}
+
+// Handle returned by a search, kept alive along with its buffers, deadline is
+// counted from now
+Local<Object> createHandle(Handle<Object> options, Handle<Array> keep) {
+    Local<Object> handle = SearchHandle::NewInstance();
+    const unsigned int deadline = options->Get(String::New("deadlineMs"))->Uint32Value();
+    
+    if (deadline > 0) {
+        node::ObjectWrap::Unwrap<SearchHandle>(handle)->stop.setDeadline(uv_hrtime() + (uint64_t) deadline * 1000000);
+    }
+    
+    keep->Set(keep->Length(), handle);
+    
+    return handle;
+}
+
+// { candidates, filtered, stubRejected, verified, matches, stub, times } of a
+// search, times in nanoseconds
+Local<Object> statsObject(const SearchStats &stats) {
+    static const char *channels[] = { "k", "r", "g", "b" };
+    
+    Local<Object> out = Object::New();
+    Local<Object> stub = Object::New();
+    Local<Object> times = Object::New();
+    
+    out->Set(String::New("candidates"), Number::New((double) stats.counts.candidates));
+    out->Set(String::New("filtered"), Number::New((double) stats.counts.filtered));
+    out->Set(String::New("stubRejected"), Number::New((double) stats.counts.stubRejected));
+    out->Set(String::New("verified"), Number::New((double) stats.counts.verified));
+    out->Set(String::New("matches"), Number::New((double) stats.counts.matches));
+    
+    stub->Set(String::New("channel"), String::New(channels[stats.stubChannel & 3]));
+    stub->Set(String::New("column"), Integer::NewFromUnsigned(stats.stubDx));
+    out->Set(String::New("stub"), stub);
+    
+    times->Set(String::New("unwrap"), Number::New((double) stats.unwrapNs));
+    times->Set(String::New("prepare"), Number::New((double) stats.prepareNs));
+    times->Set(String::New("scan"), Number::New((double) stats.scanNs));
+    times->Set(String::New("focus"), Number::New((double) stats.focusNs));
+    times->Set(String::New("marshal"), Number::New((double) stats.marshalNs));
+    out->Set(String::New("times"), times);
+    
+    return out;
+}
+
+// Way a search ended, as given to probes
+const char *stopName(StopReason reason) {
+    static const char *const names[] = { "completed", "cancelled", "timed_out" };
+    
+    return names[reason];
+}
+
+// Error of a search cut short, null if it ran to the end
+Handle<Value> stopError(Stop &stop) {
+    const StopReason reason = stop.stopped();
+    
+    if (reason == STOP_NONE) {
+        return Null();
+    }
+    
+    const bool cancelled = reason == STOP_CANCELLED;
+    Local<Object> error = Exception::Error(String::New(cancelled ? "Search cancelled" : "Search deadline exceeded"))->ToObject();
+    error->Set(String::New("code"), String::New(cancelled ? "ECANCELED" : "ETIMEDOUT"));
+    
+    return error;
+}
+
+Handle<Value> Search(const Arguments& args) {
+    HandleScope scope;
     
     const unsigned int colorTolerance = args[2]->IsNumber() ? args[2]->Int32Value() : 0;
     const unsigned int pixelTolerance = args[3]->IsNumber() ? args[3]->Int32Value() : 0;
     
-    Persistent<Function> callback = Persistent<Function>::New(Local<Function>::Cast(args[4]));
+    // options object is optional and precedes callback
+    Handle<Object> options = args[4]->IsObject() && ! args[4]->IsFunction() ? Handle<Object>::Cast(args[4]) : Object::New();
+    Handle<Value> callback = args[4]->IsFunction() ? args[4] : args[5];
     
-    // check for required matrix properties
-    if ( ! matrix1->Has(rows) || ! matrix1->Has(cols) || ! matrix1->Has(channels) || ! matrix1->Has(data)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'imgMatrix'")));
+    // unwrap matrices, image and template may come prepared with pixels
+    // already unwrapped
+    Local<Array> buffers = Array::New();
+    Cargo m1;
+    Cargo m2;
+    Image *image;
+    TemplateObject *prepared;
+    
+    const uint64_t start = uv_hrtime();
+    std::string error = unwrapImage(args[0], &m1, &image, buffers);
+    
+    if (error.empty()) {
+        error = unwrapTemplate(args[1], m1, &m2, &prepared, buffers);
     }
     
-    if ( ! matrix2->Has(rows) || ! matrix2->Has(cols) || ! matrix2->Has(channels) || ! matrix2->Has(data)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrix'")));
+    if ( ! error.empty()) {
+        return ThrowException(Exception::TypeError(String::New(error.c_str())));
     }
     
-    // unwrap matrices
-    const unsigned int m1Rows = matrix1->Get(rows)->Uint32Value();
-    const unsigned int m1Cols = matrix1->Get(cols)->Uint32Value();
-    const unsigned int m1Channels = matrix1->Get(channels)->Uint32Value();
+    const uint64_t unwrapped = uv_hrtime();
+    Local<Object> handle = createHandle(options, buffers);
     
-    const unsigned int m2Rows = matrix2->Get(rows)->Uint32Value();
-    const unsigned int m2Cols = matrix2->Get(cols)->Uint32Value();
-    const unsigned int m2Channels = matrix2->Get(channels)->Uint32Value();
+    AsyncBaton *baton = new AsyncBaton;
+    baton->request.data = baton;
+    if (callback->IsFunction()) {
+        baton->callback = Persistent<Function>::New(Handle<Function>::Cast(callback));
+    }
+    baton->buffers = Persistent<Array>::New(buffers);
+    baton->m1 = m1;
+    baton->m2 = m2;
+    baton->image = image;
+    baton->prepared = prepared;
+    baton->handle = node::ObjectWrap::Unwrap<SearchHandle>(handle);
+    baton->options = unwrapOptions(options, colorTolerance, pixelTolerance);
+    baton->options.stop = &baton->handle->stop;
+    baton->packed = options->Get(String::New("packed"))->BooleanValue();
+    baton->stream = NULL;
+    
+    if (options->Get(String::New("stats"))->BooleanValue()) {
+        baton->options.stats = &baton->stats;
+        baton->stats.unwrapNs = unwrapped - start;
+    }
     
-    // channel count validation
-    if (m1Channels < 1 || m2Channels < 1 || m1Channels > 4 || m2Channels > 4) {
-        return ThrowException(Exception::TypeError(String::New("Bad number of channels")));
+    Handle<Value> onMatches = options->Get(String::New("onMatches"));
+    
+    if (onMatches->IsFunction()) {
+        baton->stream = new MatchStream(Handle<Function>::Cast(onMatches), &baton->handle->stop);
+        baton->options.sink = baton->stream;
     }
     
-    if (abs((int) m2Channels - (int) m1Channels) > 1) {
-        return ThrowException(Exception::TypeError(String::New("Channel mismatch")));
+    const unsigned int batch = options->Get(String::New("batch"))->Uint32Value();
+    const unsigned int batchWindow = options->Get(String::New("batchWindow"))->Uint32Value();
+    
+    metrics.started();
+    PROBE_PHASE(baton, "unwrap", start, unwrapped - start);
+    baton->queued = uv_hrtime();
+    
+    if (batch > 1) {
+        queueBatched(baton, batch, batchWindow);
+    } else {
+        queueWork(&baton->request, searchDo, (uv_after_work_cb) searchAfter);
     }
     
-    // unwrap matrix.data
-    Handle<Object> m1Data = Handle<Object>::Cast(matrix1->Get(data));
-    Handle<Object> m2Data = Handle<Object>::Cast(matrix2->Get(data));
+    return scope.Close(handle);
+}
+
+// Adds a search to the pending batch, which is queued as one job once it
+// holds `size` searches or `window` milliseconds after its first one
+void queueBatched(AsyncBaton *baton, unsigned int size, unsigned int window) {
+    if ( ! batchTimerReady) {
+        uv_timer_init(uv_default_loop(), &batchTimer);
+        batchTimerReady = true;
+    }
     
-    // TODO: consider removal of channels property
-    // declared and actual channel count validation
-    if (m1Channels != m1Data->Get(String::New("length"))->Uint32Value()) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'imgMatrix'")));
+    if ( ! pendingBatch) {
+        pendingBatch = new BatchBaton;
+        pendingBatch->request.data = pendingBatch;
+        uv_timer_start(&batchTimer, batchTimeout, window, 0);
     }
     
-    if (m2Channels != m2Data->Get(String::New("length"))->Uint32Value()) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrix'")));
+    pendingBatch->batons.push_back(baton);
+    
+    if (pendingBatch->batons.size() >= size) {
+        flushBatch();
     }
+}
+
+void batchTimeout(uv_timer_t *timer, int status) {
+    flushBatch();
+}
+
+void flushBatch() {
+    uv_timer_stop(&batchTimer);
     
-    // unwrap matrix.data channels
-    Handle<Object> m1K, m1R, m1G, m1B, m1A;
-    Handle<Object> m2K, m2R, m2G, m2B, m2A;
+    if (pendingBatch) {
+        queueWork(&pendingBatch->request, batchDo, (uv_after_work_cb) batchAfter);
+        pendingBatch = NULL;
+    }
+}
+
+// searchMany(imgMatrix, tplMatrices, colorTolerance, pixelTolerance, [options], callback)
+// runs searches for all templates as a single job
+Handle<Value> SearchMany(const Arguments& args) {
+    HandleScope scope;
     
-    // TODO: check matrix data type
-    if (m1Channels == 1 || m1Channels == 2) {
-        m1K = Handle<Object>::Cast(m1Data->Get(0));
-    } else if (m1Channels == 3 || m1Channels == 4) {
-        m1R = Handle<Object>::Cast(m1Data->Get(0));
-        m1G = Handle<Object>::Cast(m1Data->Get(1));
-        m1B = Handle<Object>::Cast(m1Data->Get(2));
+    const unsigned int colorTolerance = args[2]->IsNumber() ? args[2]->Int32Value() : 0;
+    const unsigned int pixelTolerance = args[3]->IsNumber() ? args[3]->Int32Value() : 0;
+    
+    Handle<Object> options = args[4]->IsObject() && ! args[4]->IsFunction() ? Handle<Object>::Cast(args[4]) : Object::New();
+    Handle<Value> callback = args[4]->IsFunction() ? args[4] : args[5];
+    
+    if ( ! args[1]->IsArray()) {
+        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrices'")));
     }
     
-    if (m1Channels == 2) {
-        m1A = Handle<Object>::Cast(m1Data->Get(1));
-    } else if (m1Channels == 4) {
-        m1A = Handle<Object>::Cast(m1Data->Get(3));
+    Handle<Array> matrices = Handle<Array>::Cast(args[1]);
+    Local<Array> buffers = Array::New();
+    Cargo m1;
+    Image *image;
+    
+    std::string error = unwrapImage(args[0], &m1, &image, buffers);
+    
+    ManyBaton *baton = new ManyBaton;
+    baton->templates.resize(matrices->Length());
+    baton->prepared.resize(matrices->Length());
+    
+    for (uint32_t i = 0; error.empty() && i < matrices->Length(); i++) {
+        error = unwrapTemplate(matrices->Get(i), m1, &baton->templates[i], &baton->prepared[i], buffers);
     }
     
-    if (m2Channels == 1 || m2Channels == 2) {
-        m2K = Handle<Object>::Cast(m2Data->Get(0));
-    } else if (m2Channels == 3 || m2Channels == 4) {
-        m2R = Handle<Object>::Cast(m2Data->Get(0));
-        m2G = Handle<Object>::Cast(m2Data->Get(1));
-        m2B = Handle<Object>::Cast(m2Data->Get(2));
+    if ( ! error.empty()) {
+        delete baton;
+        return ThrowException(Exception::TypeError(String::New(error.c_str())));
     }
     
-    if (m2Channels == 2) {
-        m2A = Handle<Object>::Cast(m2Data->Get(1));
-    } else if (m2Channels == 4) {
-        m2A = Handle<Object>::Cast(m2Data->Get(3));
+    Local<Object> handle = createHandle(options, buffers);
+    
+    baton->request.data = baton;
+    if (callback->IsFunction()) {
+        baton->callback = Persistent<Function>::New(Handle<Function>::Cast(callback));
     }
+    baton->buffers = Persistent<Array>::New(buffers);
+    baton->m1 = m1;
+    baton->image = image;
+    baton->handle = node::ObjectWrap::Unwrap<SearchHandle>(handle);
+    baton->options = unwrapOptions(options, colorTolerance, pixelTolerance);
+    baton->options.stop = &baton->handle->stop;
+    baton->packed = options->Get(String::New("packed"))->BooleanValue();
+    
+    metrics.started();
+    baton->queued = uv_hrtime();
     
-    // unwrap channel buffers
-    size_t m1KL, m1RL, m1GL, m1BL, m1AL;
-    char *m1KD, *m1RD, *m1GD, *m1BD, *m1AD;
-    float *m1KDi, *m1RDi, *m1GDi, *m1BDi, *m1ADi;
+    queueWork(&baton->request, searchManyDo, (uv_after_work_cb) searchManyAfter);
     
-    m1KL = m1RL = m1GL = m1BL = m1AL = 0;
-    m1KDi = m1RDi = m1GDi = m1BDi = m1ADi = 0;
+    return scope.Close(handle);
+}
+
+void searchDo(uv_work_t *request) {
+    AsyncBaton *baton = static_cast<AsyncBaton*>(request->data);
     
-    size_t m2KL, m2RL, m2GL, m2BL, m2AL;
-    char *m2KD, *m2RD, *m2GD, *m2BD, *m2AD;
-    float *m2KDi, *m2RDi, *m2GDi, *m2BDi, *m2ADi;
+    const bool pyramid = baton->options.pyramid > 1;
+    SearchOptions options = baton->options;
+    const uint64_t began = uv_hrtime();
     
-    m2KL = m2RL = m2GL = m2BL = m2AL = 0;
-    m2KDi = m2RDi = m2GDi = m2BDi = m2ADi = 0;
+    metrics.waited(began - baton->queued);
+    PROBE_SEARCH_START(baton, began - baton->queued);
     
-    if (m2Channels == 1 || m2Channels == 2) {
-        m1KL = node::Buffer::Length(m1K) * sizeof(float);
-        m1KD = node::Buffer::Data(m1K);
-        m1KDi = (float *) malloc(m1KL);
-        memcpy(m1KDi, &m1KD[0], m1KL);
-        
-        m2KL = node::Buffer::Length(m2K) * sizeof(float);
-        m2KD = node::Buffer::Data(m2K);
-        m2KDi = (float *) malloc(m2KL);
-        memcpy(m2KDi, &m2KD[0], m2KL);
+    // cancelled or out of time while queued
+    if (options.stop->check()) {
+        workDone(baton, 0, began, uv_hrtime(), *options.stop);
+        return;
+    }
+    
+    // suppression keeps matches in scan order and replaces them by more
+    // accurate ones, so it needs every match and results are limited after it
+    if (options.focus) {
+        options.maxResults = 0;
     }
     
-    if (m2Channels == 3 || m2Channels == 4) {
-        m1RL = node::Buffer::Length(m1R) * sizeof(float);
-        m1RD = node::Buffer::Data(m1R);
-        m1RDi = (float *) malloc(m1RL);
-        memcpy(m1RDi, &m1RD[0], m1RL);
+    if (baton->m1.type == PIXEL_UINT8) {
+        PreparedImage<unsigned char> *image = baton->image ? baton->image->uint8 : NULL;
+        Prepared<unsigned char> *prepared = baton->prepared ? baton->prepared->uint8 : NULL;
+        const Matrix<unsigned char> m1 = image ? image->matrix : unpack<unsigned char>(baton->m1);
+        const Matrix<unsigned char> m2 = prepared ? prepared->matrix : unpack<unsigned char>(baton->m2);
+        baton->result = pyramid ? pyramidSearch(m1, m2, options, searchPool, prepared, image) :
+            search(m1, m2, options, searchPool, prepared ? &prepared->stub : NULL, image);
+    } else {
+        PreparedImage<float> *image = baton->image ? baton->image->float32 : NULL;
+        Prepared<float> *prepared = baton->prepared ? baton->prepared->float32 : NULL;
+        const Matrix<float> m1 = image ? image->matrix : unpack<float>(baton->m1);
+        const Matrix<float> m2 = prepared ? prepared->matrix : unpack<float>(baton->m2);
+        baton->result = pyramid ? pyramidSearch(m1, m2, options, searchPool, prepared, image) :
+            search(m1, m2, options, searchPool, prepared ? &prepared->stub : NULL, image);
+    }
+    
+    const uint64_t scanned = uv_hrtime();
+    finish(baton->result, baton->m2, baton->options);
+    const uint64_t focused = uv_hrtime();
+    
+    if (baton->packed) {
+        pack(baton->result, -1, baton->packedResult);
+    }
+    
+    const uint64_t done = uv_hrtime();
+    
+    if (options.stats) {
+        options.stats->focusNs = focused - scanned;
+        options.stats->marshalNs = done - focused;
+    }
+    
+    PROBE_PHASE(baton, "search", began, scanned - began);
+    PROBE_PHASE(baton, "focus", scanned, focused - scanned);
+    workDone(baton, baton->packed ? baton->packedResult.accuracy.size() : baton->result.size(), began, done, *options.stop);
+}
+
+// Exit of every search run by a thread, whether it ran to the end, was cut
+// short or never started scanning
+void workDone(void *id, size_t matches, uint64_t began, uint64_t done, Stop &stop) {
+    const uint64_t busy = done - began;
+    
+    metrics.worked(busy);
+    PROBE_SEARCH_DONE(id, matches, busy, stopName(stop.stopped()));
+}
+
+// Suppresses overlapping matches if asked to and limits them afterwards
+void finish(std::vector<Match> &result, const Cargo &m2, const SearchOptions &options) {
+    if (options.focus) {
+        result = focus(result, m2.rows, m2.cols);
         
-        m1GL = node::Buffer::Length(m1G) * sizeof(float);
-        m1GD = node::Buffer::Data(m1G);
-        m1GDi = (float *) malloc(m1GL);
-        memcpy(m1GDi, &m1GD[0], m1GL);
+        if (options.maxResults > 0 && result.size() > options.maxResults) {
+            result.resize(options.maxResults);
+        }
+    }
+}
+
+void searchManyDo(uv_work_t *request) {
+    ManyBaton *baton = static_cast<ManyBaton*>(request->data);
+    const size_t count = baton->templates.size();
+    SearchOptions options = baton->options;
+    const uint64_t began = uv_hrtime();
+    
+    metrics.waited(began - baton->queued);
+    PROBE_SEARCH_START(baton, began - baton->queued);
+    
+    if (options.stop->check()) {
+        baton->results.resize(count);
+        workDone(baton, 0, began, uv_hrtime(), *options.stop);
+        return;
+    }
+    
+    if (options.focus) {
+        options.maxResults = 0;
+    }
+    
+    if (baton->m1.type == PIXEL_UINT8) {
+        PreparedImage<unsigned char> *image = baton->image ? baton->image->uint8 : NULL;
+        std::vector<Matrix<unsigned char> > templates;
+        std::vector<Prepared<unsigned char>*> prepared(count);
         
-        m1BL = node::Buffer::Length(m1B) * sizeof(float);
-        m1BD = node::Buffer::Data(m1B);
-        m1BDi = (float *) malloc(m1BL);
-        memcpy(m1BDi, &m1BD[0], m1BL);
+        for (size_t i = 0; i < count; i++) {
+            prepared[i] = baton->prepared[i] ? baton->prepared[i]->uint8 : NULL;
+            templates.push_back(prepared[i] ? prepared[i]->matrix : unpack<unsigned char>(baton->templates[i]));
+        }
         
-        m2RL = node::Buffer::Length(m2R) * sizeof(float);
-        m2RD = node::Buffer::Data(m2R);
-        m2RDi = (float *) malloc(m2RL);
-        memcpy(m2RDi, &m2RD[0], m2RL);
+        const Matrix<unsigned char> m1 = image ? image->matrix : unpack<unsigned char>(baton->m1);
+        baton->results = searchMany(m1, templates, options, searchPool, &prepared, image);
+    } else {
+        PreparedImage<float> *image = baton->image ? baton->image->float32 : NULL;
+        std::vector<Matrix<float> > templates;
+        std::vector<Prepared<float>*> prepared(count);
         
-        m2GL = node::Buffer::Length(m2G) * sizeof(float);
-        m2GD = node::Buffer::Data(m2G);
-        m2GDi = (float *) malloc(m2GL);
-        memcpy(m2GDi, &m2GD[0], m2GL);
+        for (size_t i = 0; i < count; i++) {
+            prepared[i] = baton->prepared[i] ? baton->prepared[i]->float32 : NULL;
+            templates.push_back(prepared[i] ? prepared[i]->matrix : unpack<float>(baton->templates[i]));
+        }
         
-        m2BL = node::Buffer::Length(m2B) * sizeof(float);
-        m2BD = node::Buffer::Data(m2B);
-        m2BDi = (float *) malloc(m2BL);
-        memcpy(m2BDi, &m2BD[0], m2BL);
-    }
-    
-    if (m1Channels == 2 || m1Channels == 4) {
-        m1AL = node::Buffer::Length(m1A) * sizeof(float);
-        m1AD = (char*) node::Buffer::Data(m1A);
-        m1ADi = (float *) malloc(m1AL);
-        memcpy(m1ADi, &m1AD[0], m1AL);
-    }
-    
-    if (m2Channels == 2 || m2Channels == 4) {
-        m2AL = node::Buffer::Length(m2A) * sizeof(float);
-        m2AD = (char*) node::Buffer::Data(m2A);
-        m2ADi = (float *) malloc(m2AL);
-        memcpy(m2ADi, &m2AD[0], m2AL);
-    }
-    
-    // validate channel buffer lengths
-    if (m1Channels == 2 && m1KL != m1AL) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'imgMatrix.data'")));
-    } else if (m1Channels == 3 && (m1RL != m1GL || m1RL != m1BL)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'imgMatrix.data'")));
-    } else if (m1Channels == 4 && (m1RL != m1GL || m1RL != m1BL || m1RL != m1AL)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'imgMatrix.data'")));
-    }
-    
-    if (m2Channels == 2 && m2KL != m2AL) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrix.data'")));
-    } else if (m2Channels == 3 && (m2RL != m2GL || m2RL != m2BL)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrix.data'")));
-    } else if (m2Channels == 4 && (m2RL != m2GL || m2RL != m2BL || m2RL != m2AL)) {
-        return ThrowException(Exception::TypeError(String::New("Bad argument 'tplMatrix.data'")));
-    }
-    
-    Cargo *m1 = new Cargo;
-    m1->rows = m1Rows;
-    m1->cols = m1Cols;
-    m1->channels = m1Channels;
-    m1->k = m1KDi;
-    m1->r = m1RDi;
-    m1->g = m1GDi;
-    m1->b = m1BDi;
-    m1->a = m1ADi;
-    
-    Cargo *m2 = new Cargo;
-    m2->rows = m2Rows;
-    m2->cols = m2Cols;
-    m2->channels = m2Channels;
-    m2->k = m2KDi;
-    m2->r = m2RDi;
-    m2->g = m2GDi;
-    m2->b = m2BDi;
-    m2->a = m2ADi;
+        const Matrix<float> m1 = image ? image->matrix : unpack<float>(baton->m1);
+        baton->results = searchMany(m1, templates, options, searchPool, &prepared, image);
+    }
     
-    AsyncBaton *baton = new AsyncBaton;
-    baton->request.data = baton;
-    baton->callback = callback;
-    baton->m1 = m1;
-    baton->m2 = m2;
-    baton->colorTolerance = colorTolerance;
-    baton->pixelTolerance = pixelTolerance;
+    const uint64_t scanned = uv_hrtime();
+    size_t matches = 0;
     
-    uv_queue_work(uv_default_loop(), &baton->request, searchDo, (uv_after_work_cb) searchAfter);
+    for (size_t i = 0; i < count; i++) {
+        finish(baton->results[i], baton->templates[i], baton->options);
+        matches += baton->results[i].size();
+        
+        if (baton->packed) {
+            pack(baton->results[i], (int32_t) i, baton->packedResult);
+        }
+    }
     
-    return Undefined();
+    const uint64_t done = uv_hrtime();
+    
+    PROBE_PHASE(baton, "search", began, scanned - began);
+    PROBE_PHASE(baton, "focus", scanned, done - scanned);
+    workDone(baton, matches, began, done, *options.stop);
 }
 
-void searchDo(uv_work_t *request) {
-    AsyncBaton *baton = static_cast<AsyncBaton*>(request->data);
-    Cargo *m1D = static_cast<Cargo*>(baton->m1);
-    Cargo *m2D = static_cast<Cargo*>(baton->m2);
-    
-    Matrix m1 = {
-        m1D->rows,
-        m1D->cols,
-        m1D->channels,
-        MatrixChannel(m1D->k, m1D->rows, m1D->cols),
-        MatrixChannel(m1D->r, m1D->rows, m1D->cols),
-        MatrixChannel(m1D->g, m1D->rows, m1D->cols),
-        MatrixChannel(m1D->b, m1D->rows, m1D->cols),
-        MatrixChannel(m1D->a, m1D->rows, m1D->cols)
-    };
-    
-    Matrix m2 = {
-        m2D->rows,
-        m2D->cols,
-        m2D->channels,
-        MatrixChannel(m2D->k, m2D->rows, m2D->cols),
-        MatrixChannel(m2D->r, m2D->rows, m2D->cols),
-        MatrixChannel(m2D->g, m2D->rows, m2D->cols),
-        MatrixChannel(m2D->b, m2D->rows, m2D->cols),
-        MatrixChannel(m2D->a, m2D->rows, m2D->cols)        
-    };
-    
-    std::vector<Match> result = search(m1, m2, baton->colorTolerance, baton->pixelTolerance);
-    baton->result = result;
+// Appends matches to flat arrays and frees them, `index` of -1 leaves out
+// template indexes
+void pack(std::vector<Match> &result, int32_t index, PackedResult &out) {
+    out.positions.reserve(out.positions.size() + result.size() * 2);
+    out.accuracy.reserve(out.accuracy.size() + result.size());
+    
+    for (std::vector<Match>::iterator it = result.begin(); it != result.end(); it++) {
+        out.positions.push_back((int32_t) it->col);
+        out.positions.push_back((int32_t) it->row);
+        out.accuracy.push_back((float) it->accuracy);
+        
+        if (index >= 0) {
+            out.templates.push_back(index);
+        }
+    }
+    
+    std::vector<Match>().swap(result);
 }
 
-void searchAfter(uv_work_t *request) {
-    AsyncBaton *baton = static_cast<AsyncBaton*>(request->data);
+// Typed array of global constructor `type` holding a copy of `data`
+static Local<Object> typedArray(const char *type, const void *data, size_t count, size_t size) {
+    Local<Function> constructor = Local<Function>::Cast(Context::GetCurrent()->Global()->Get(String::New(type)));
+    Handle<Value> argv[] = { Integer::NewFromUnsigned((uint32_t) count) };
+    Local<Object> out = constructor->NewInstance(1, argv);
+    
+    if (count > 0) {
+        memcpy(out->GetIndexedPropertiesExternalArrayData(), data, count * size);
+    }
     
-    Local<Array> out = Array::New((int) baton->result.size());
-    Local<Object> match;
+    return out;
+}
+
+// { length, positions, accuracy, [templates] } of packed matches, made with
+// a few V8 calls however many matches there are
+Local<Object> packedArrays(const PackedResult &packed, bool templates) {
+    Local<Object> out = Object::New();
+    const size_t length = packed.accuracy.size();
+    
+    out->Set(String::New("length"), Integer::NewFromUnsigned((uint32_t) length));
+    out->Set(String::New("positions"), typedArray("Int32Array", packed.positions.empty() ? NULL : &packed.positions[0], length * 2, sizeof(int32_t)));
+    out->Set(String::New("accuracy"), typedArray("Float32Array", packed.accuracy.empty() ? NULL : &packed.accuracy[0], length, sizeof(float)));
+    
+    if (templates) {
+        out->Set(String::New("templates"), typedArray("Int32Array", packed.templates.empty() ? NULL : &packed.templates[0], length, sizeof(int32_t)));
+    }
     
+    return out;
+}
+
+// { row, col, accuracy, [template] } objects of matches appended to `out`,
+// template index is left out when negative
+static void matchObjects(const std::vector<Match> &result, int32_t index, Local<Array> out) {
     Local<String> row = String::New("row");
     Local<String> col = String::New("col");
     Local<String> accuracy = String::New("accuracy");
+    Local<String> templateIndex = String::New("template");
     
-    int i = 0;
-    for (std::vector<Match>::iterator it = baton->result.begin(); it != baton->result.end(); it++) {
-        match = Object::New();
+    uint32_t i = out->Length();
+    for (std::vector<Match>::const_iterator it = result.begin(); it != result.end(); it++) {
+        Local<Object> match = Object::New();
         match->Set(row, Number::New(it->row));
         match->Set(col, Number::New(it->col));
         match->Set(accuracy, Number::New(it->accuracy));
         
+        if (index >= 0) {
+            match->Set(templateIndex, Number::New(index));
+        }
+        
         out->Set(i++, match);
     }
+}
+
+void searchAfter(uv_work_t *request) {
+    HandleScope scope;
+    AsyncBaton *baton = static_cast<AsyncBaton*>(request->data);
+    const uint64_t start = uv_hrtime();
+    
+    Local<Object> result;
+    
+    if (baton->packed) {
+        result = packedArrays(baton->packedResult, false);
+    } else {
+        Local<Array> out = Array::New((int) baton->result.size());
+        matchObjects(baton->result, -1, out);
+        result = out;
+    }
+    
+    const uint64_t marshalled = uv_hrtime();
+    baton->stats.marshalNs += marshalled - start;
+    
+    metrics.finished(baton->handle->stop.stopped(), baton->handle->stop.scanned());
+    PROBE_PHASE(baton, "marshal", start, marshalled - start);
+    
+    // matches streamed so far come before the final callback
+    if (baton->stream) {
+        baton->stream->close();
+    }
+    
+    if ( ! baton->callback.IsEmpty()) {
+        Handle<Value> argv[] = { stopError(baton->handle->stop), result, Undefined() };
+        
+        if (baton->options.stats) {
+            argv[2] = statsObject(baton->stats);
+        }
+        
+        baton->callback->Call(Context::GetCurrent()->Global(), baton->options.stats ? 3 : 2, argv);
+        baton->callback.Dispose();
+    }
     
-    Handle<Value> argv[] = { Null(), out };
-    baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+    baton->buffers.Dispose();
     
     delete baton;
     baton = NULL;
 }
 
-std::vector<Match> search(Matrix &m1, Matrix &m2, unsigned int colorTolerance, unsigned int pixelTolerance) {
-    Eigen::RowVectorXf devK, devR, devG, devB, devA;
-    Eigen::RowVectorXf dev = Eigen::RowVectorXf::Zero(m2.cols);
+Pool *pool() {
+    if ( ! searchPool) {
+        searchPool = new Pool(searchPoolSize > 0 ? searchPoolSize : cpuCount(), uv_default_loop());
+    }
     
-    if (m1.channels < 3) {
-        devK = stdDev(m2.k);
-        dev += devK;
-    } else {
-        devR = stdDev(m2.r);
-        devG = stdDev(m2.g);
-        devB = stdDev(m2.b);
-        dev += devR + devG + devB;
+    return searchPool;
+}
+
+// Queues search work to the search pool instead of the libuv one
+void queueWork(uv_work_t *request, uv_work_cb work, uv_after_work_cb after) {
+    pool()->queue(request, work, after);
+}
+
+// setPoolSize(size) sizes the search pool before the first search, returns
+// the size in effect
+Handle<Value> SetPoolSize(const Arguments& args) {
+    HandleScope scope;
+    
+    if (args[0]->IsNumber()) {
+        const unsigned int size = args[0]->Uint32Value();
+        
+        if (size < 1) {
+            return ThrowException(Exception::TypeError(String::New("Bad argument 'size'")));
+        }
+        
+        if (searchPool && size != searchPool->size()) {
+            return ThrowException(Exception::Error(String::New("Search pool already started")));
+        }
+        
+        searchPoolSize = size;
     }
     
-    Eigen::RowVectorXf::Index maxCol;
-    dev.maxCoeff(&maxCol);
-    const unsigned int dx = (const unsigned int) maxCol;
+    const unsigned int size = searchPool ? searchPool->size() : (searchPoolSize > 0 ? searchPoolSize : cpuCount());
     
-    float* dataM1;
-    float* dataM2;
+    return scope.Close(Integer::NewFromUnsigned(size));
+}
+
+// getMetrics() snapshot of process-wide counters in Prometheus text format
+Handle<Value> GetMetrics(const Arguments& args) {
+    HandleScope scope;
     
-    if (m1.channels < 3) {
-        dataM1 = &m1.k(0);
-        dataM2 = &m2.k(0);
-    } else {
-        if (devR.sum() > devG.sum()) {
-            dataM1 = &m1.r(0);
-            dataM2 = &m2.r(0);
-        } else if (devG.sum() > devB.sum()) {
-            dataM1 = &m1.g(0);
-            dataM2 = &m2.g(0);
-        } else {
-            dataM1 = &m1.b(0);
-            dataM2 = &m2.b(0);
-        }
+    const std::string text = metrics.prometheus();
+    
+    return scope.Close(String::New(text.c_str(), (int) text.size()));
+}
+
+// Runs searches of a batch back to back
+void batchDo(uv_work_t *request) {
+    BatchBaton *batch = static_cast<BatchBaton*>(request->data);
+    
+    for (size_t i = 0; i < batch->batons.size(); i++) {
+        searchDo(&batch->batons[i]->request);
     }
+}
+
+// Calls back searches of a batch in the order they were made, an exception
+// thrown by one callback does not keep the rest from being called
+void batchAfter(uv_work_t *request) {
+    HandleScope scope;
+    BatchBaton *batch = static_cast<BatchBaton*>(request->data);
     
-    MatrixChannel stubM1(dataM1, m1.rows, m1.cols);
-    MatrixChannel stubM2(dataM2, m2.rows, m2.cols);
-    
-    Eigen::VectorXf stub = stubM2.block(0, dx, m2.rows, 1);
-    Eigen::ArrayXf stubDiff;
-    Eigen::ArrayXXf matDiff;
-    
-    unsigned int r = 0;
-    unsigned int c = dx;
-    const unsigned int mr = m1.rows - m2.rows;
-    const unsigned int mc = m1.cols - m2.cols + c;
-    
-    // TODO: adjust point colot tolerance according to alpha channel
-    // unsigned int pointColorTolerance = 0;
-    unsigned int pixelMiss = 0;
-    float accuracy = 0;
-    
-    std::vector<Match> out;
-    do {
-        do {
-            stubDiff = (stubM1.block(r, c, m2.rows, 1) - stub).array().abs();
-            pixelMiss = (unsigned int) (stubDiff > (float) colorTolerance).count();
-            if (pixelMiss > pixelTolerance) continue;
-            
-            if (m1.channels < 3) {
-                matDiff  = (m1.k.block(r, c - dx, m2.rows, m2.cols) - m2.k).array().abs();
-            } else {
-                matDiff  = (m1.r.block(r, c - dx, m2.rows, m2.cols) - m2.r).array().abs();
-                matDiff += (m1.g.block(r, c - dx, m2.rows, m2.cols) - m2.g).array().abs();
-                matDiff += (m1.b.block(r, c - dx, m2.rows, m2.cols) - m2.b).array().abs();
-            }
-            
-            pixelMiss = (unsigned int) (matDiff > (float) colorTolerance).count();
-            
-            if (pixelMiss <= pixelTolerance) {
-                accuracy = matDiff.maxCoeff();
-                accuracy = (accuracy > 0) ? (matDiff / accuracy).sum() : 0;
-                
-                Match res = {
-                    r,
-                    (c - dx),
-                    accuracy
-                };
-                out.push_back(res);
-            }
-        } while (++c <= mc);
-        c = dx;
-    } while (++r <= mr);
+    for (size_t i = 0; i < batch->batons.size(); i++) {
+        TryCatch tryCatch;
+        searchAfter(&batch->batons[i]->request);
+        
+        if (tryCatch.HasCaught()) {
+            node::FatalException(tryCatch);
+        }
+    }
     
-    return out;
+    delete batch;
+    batch = NULL;
 }
 
-Eigen::RowVectorXf stdDev(MatrixChannel &m) {
-    const unsigned int N = (unsigned int) m.rows();
-    return ((m.rowwise() - (m.colwise().sum() / (float) N)).array().square().colwise().sum() / (float) N).array().sqrt();
+// Matches of all templates in template order, each tagged with its index
+void searchManyAfter(uv_work_t *request) {
+    HandleScope scope;
+    ManyBaton *baton = static_cast<ManyBaton*>(request->data);
+    const uint64_t start = uv_hrtime();
+    
+    Local<Object> result;
+    
+    if (baton->packed) {
+        result = packedArrays(baton->packedResult, true);
+    } else {
+        Local<Array> out = Array::New();
+        
+        for (size_t t = 0; t < baton->results.size(); t++) {
+            matchObjects(baton->results[t], (int32_t) t, out);
+        }
+        
+        result = out;
+    }
+    
+    metrics.finished(baton->handle->stop.stopped(), baton->handle->stop.scanned());
+    PROBE_PHASE(baton, "marshal", start, uv_hrtime() - start);
+    
+    if ( ! baton->callback.IsEmpty()) {
+        Handle<Value> argv[] = { stopError(baton->handle->stop), result };
+        baton->callback->Call(Context::GetCurrent()->Global(), 2, argv);
+        baton->callback.Dispose();
+    }
+    
+    baton->buffers.Dispose();
+    
+    delete baton;
+    baton = NULL;
 }
 
 void Init(Handle<Object> exports) {
+    // IMAGESEARCH_ISA caps the instruction set of the matching kernel
+    const char *isa = selectKernel(getenv("IMAGESEARCH_ISA"));
+    
+    // IMAGESEARCH_POOL_SIZE sets threads running searches
+    const char *poolSize = getenv("IMAGESEARCH_POOL_SIZE");
+    searchPoolSize = (poolSize && atoi(poolSize) > 0) ? (unsigned int) atoi(poolSize) : 0;
+    
     exports->Set(String::NewSymbol("search"), FunctionTemplate::New(Search)->GetFunction());
+    exports->Set(String::NewSymbol("searchMany"), FunctionTemplate::New(SearchMany)->GetFunction());
+    exports->Set(String::NewSymbol("setPoolSize"), FunctionTemplate::New(SetPoolSize)->GetFunction());
+    exports->Set(String::NewSymbol("getMetrics"), FunctionTemplate::New(GetMetrics)->GetFunction());
+    TemplateObject::Init(exports);
+    SearchHandle::Init();
+    Image::Init(exports);
+    exports->Set(String::NewSymbol("isa"), String::New(isa));
 }
 
 NODE_MODULE(search, Init)
@@ -1,54 +1,136 @@
 #ifndef SEARCH_H
 #define SEARCH_H
 
+#include <string>
+#include <vector>
+
 #include <node.h>
-#include <Eigen/Dense>
+
+#include <Eigen/Core>
+
+#include "engine.h"
 
 using namespace v8;
 
-typedef Eigen::Map<Eigen::Matrix<float, -1, -1, Eigen::RowMajor> > MatrixChannel;
+typedef enum {
+    PIXEL_FLOAT,
+    PIXEL_UINT8
+} PixelType;
 
 typedef struct {
     unsigned int rows;
     unsigned int cols;
     unsigned int channels;
-    float *k;
-    float *r;
-    float *g;
-    float *b;
-    float *a;
+    unsigned int stride;
+    PixelType type;
+    // samples from row to row, 0 when rows are not padded
+    unsigned int pitch;
+    void *k;
+    void *r;
+    void *g;
+    void *b;
+    void *a;
 } Cargo;
 
-typedef struct {
-    unsigned int rows;
-    unsigned int cols;
-    unsigned int channels;
-    MatrixChannel k;
-    MatrixChannel r;
-    MatrixChannel g;
-    MatrixChannel b;
-    MatrixChannel a;
-} Matrix;
+// owned pixel copies, aligned for vector loads
+typedef std::vector<unsigned char, Eigen::aligned_allocator<unsigned char> > PixelStorage;
 
+// Matches as flat arrays handed to typed arrays in one copy each, x and y
+// pairs in `positions`, template indexes of searchMany in `templates`
 typedef struct {
-    unsigned int row;
-    unsigned int col;
-    double accuracy;
-} Match;
+    std::vector<int32_t> positions;
+    std::vector<float> accuracy;
+    std::vector<int32_t> templates;
+} PackedResult;
+
+class TemplateObject;
+class Image;
+class SearchHandle;
+class MatchStream;
 
 struct AsyncBaton {
     uv_work_t request;
     Persistent<Function> callback;
-    Cargo *m1;
-    Cargo *m2;
-    unsigned int colorTolerance;
-    unsigned int pixelTolerance;
+    Persistent<Array> buffers;
+    Cargo m1;
+    Cargo m2;
+    // prepared image and template, NULL when unwrapped per search
+    Image *image;
+    TemplateObject *prepared;
+    // cancels the search, kept alive in `buffers`
+    SearchHandle *handle;
+    // calls back matches while scanning, NULL without `onMatches`
+    MatchStream *stream;
+    SearchOptions options;
     std::vector<Match> result;
+    // packed in the worker when asked to, `result` is then left empty
+    bool packed;
+    PackedResult packedResult;
+    // filled in when `options.stats` points at it
+    SearchStats stats;
+    // uv_hrtime() when queued
+    uint64_t queued;
 };
 
+// searches run as a single threadpool job
+struct BatchBaton {
+    uv_work_t request;
+    std::vector<AsyncBaton*> batons;
+};
+
+// one image searched for several templates
+struct ManyBaton {
+    uv_work_t request;
+    Persistent<Function> callback;
+    Persistent<Array> buffers;
+    Cargo m1;
+    std::vector<Cargo> templates;
+    Image *image;
+    std::vector<TemplateObject*> prepared;
+    SearchHandle *handle;
+    SearchOptions options;
+    std::vector<std::vector<Match> > results;
+    bool packed;
+    PackedResult packedResult;
+    uint64_t queued;
+};
+
+template <typename T>
+Matrix<T> unpack(const Cargo &m) {
+    Matrix<T> out = {
+        m.rows,
+        m.cols,
+        m.channels,
+        Matrix<T>::map(static_cast<T*>(m.k), m.rows, m.cols, m.stride, m.pitch),
+        Matrix<T>::map(static_cast<T*>(m.r), m.rows, m.cols, m.stride, m.pitch),
+        Matrix<T>::map(static_cast<T*>(m.g), m.rows, m.cols, m.stride, m.pitch),
+        Matrix<T>::map(static_cast<T*>(m.b), m.rows, m.cols, m.stride, m.pitch),
+        Matrix<T>::map(static_cast<T*>(m.a), m.rows, m.cols, m.stride, m.pitch)
+    };
+    
+    return out;
+}
+
+bool unwrapData(Handle<Object> data, Cargo *m, Handle<Array> keep);
+std::string unwrapMatrix(Handle<Value> value, const std::string &name, Cargo *m, Handle<Array> keep);
+void assignPlanes(Cargo *m, void **planes);
+void copyPixels(Cargo *m, PixelStorage &storage, size_t alignment);
+
 void searchDo(uv_work_t *request);
+void workDone(void *id, size_t matches, uint64_t began, uint64_t done, Stop &stop);
 void searchAfter(uv_work_t *request);
-std::vector<Match> search(Matrix &m1, Matrix &m2, unsigned int colorTolerance, unsigned int pixelTolerance);
-Eigen::RowVectorXf stdDev(MatrixChannel &m);
+Pool *pool();
+void queueWork(uv_work_t *request, uv_work_cb work, uv_after_work_cb after);
+void queueBatched(AsyncBaton *baton, unsigned int size, unsigned int window);
+void batchTimeout(uv_timer_t *timer, int status);
+void flushBatch();
+void batchDo(uv_work_t *request);
+void batchAfter(uv_work_t *request);
+void searchManyDo(uv_work_t *request);
+void searchManyAfter(uv_work_t *request);
+void finish(std::vector<Match> &result, const Cargo &m2, const SearchOptions &options);
+void pack(std::vector<Match> &result, int32_t index, PackedResult &out);
+Local<Object> packedArrays(const PackedResult &packed, bool templates);
+Local<Object> statsObject(const SearchStats &stats);
 
 #endif
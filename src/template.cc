@@ -0,0 +1,75 @@
+#include <node.h>
+
+#include "template.h"
+
+using namespace v8;
+
+Persistent<FunctionTemplate> TemplateObject::constructor;
+
+TemplateObject::TemplateObject() : uint8(NULL), float32(NULL) {}
+
+TemplateObject::~TemplateObject() {
+    delete uint8;
+    delete float32;
+    
+    V8::AdjustAmountOfExternalAllocatedMemory(-(int) storage.size());
+}
+
+void TemplateObject::Init(Handle<Object> exports) {
+    Local<FunctionTemplate> tpl = FunctionTemplate::New(New);
+    tpl->SetClassName(String::NewSymbol("Template"));
+    tpl->InstanceTemplate()->SetInternalFieldCount(1);
+    
+    constructor = Persistent<FunctionTemplate>::New(tpl);
+    exports->Set(String::NewSymbol("Template"), constructor->GetFunction());
+}
+
+bool TemplateObject::HasInstance(Handle<Value> value) {
+    return ! constructor.IsEmpty() && value->IsObject() && constructor->HasInstance(value);
+}
+
+// new Template(matrix) takes the same matrix object as search()
+Handle<Value> TemplateObject::New(const Arguments& args) {
+    HandleScope scope;
+    
+    if ( ! args.IsConstructCall()) {
+        Handle<Value> argv[] = { args[0] };
+        return scope.Close(constructor->GetFunction()->NewInstance(1, argv));
+    }
+    
+    Cargo m;
+    std::string error = unwrapMatrix(args[0], "matrix", &m, Array::New());
+    
+    // statistics are computed right away and need some pixels
+    if (error.empty() && (m.rows < 1 || m.cols < 1)) {
+        error = "Bad argument 'matrix'";
+    }
+    
+    if ( ! error.empty()) {
+        return ThrowException(Exception::TypeError(String::New(error.c_str())));
+    }
+    
+    TemplateObject *t = new TemplateObject();
+    
+    // copy keeps interleaved pixels interleaved, so that vector kernels
+    // still apply against interleaved images
+    copyPixels(&m, t->storage, 1);
+    t->cargo = m;
+    
+    if (m.type == PIXEL_UINT8) {
+        t->uint8 = new Prepared<unsigned char>(unpack<unsigned char>(m));
+    } else {
+        t->float32 = new Prepared<float>(unpack<float>(m));
+    }
+    
+    V8::AdjustAmountOfExternalAllocatedMemory((int) t->storage.size());
+    
+    t->Wrap(args.This());
+    
+    args.This()->Set(String::New("rows"), Integer::NewFromUnsigned(m.rows), ReadOnly);
+    args.This()->Set(String::New("cols"), Integer::NewFromUnsigned(m.cols), ReadOnly);
+    args.This()->Set(String::New("channels"), Integer::NewFromUnsigned(m.channels), ReadOnly);
+    args.This()->Set(String::New("type"), String::New(m.type == PIXEL_FLOAT ? "float" : "uint8"), ReadOnly);
+    
+    return args.This();
+}
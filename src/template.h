@@ -0,0 +1,32 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <node.h>
+
+#include "search.h"
+
+using namespace v8;
+
+// Template pixels copied once, in their original layout, along with the
+// precomputation that searches against many images would otherwise repeat
+class TemplateObject : public node::ObjectWrap {
+public:
+    static void Init(Handle<Object> exports);
+    static bool HasInstance(Handle<Value> value);
+    
+    // owned pixels, one of the prepared pointers is set by pixel type
+    Cargo cargo;
+    Prepared<unsigned char> *uint8;
+    Prepared<float> *float32;
+
+private:
+    TemplateObject();
+    ~TemplateObject();
+    
+    static Handle<Value> New(const Arguments& args);
+    static Persistent<FunctionTemplate> constructor;
+    
+    PixelStorage storage;
+};
+
+#endif
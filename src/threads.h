@@ -0,0 +1,99 @@
+#ifndef THREADS_H
+#define THREADS_H
+
+// Threads, locks and the clock of the search engine come from the libuv of
+// node. The standalone benchmark (IMAGESEARCH_BENCH) is built without node,
+// so the same calls are made on pthreads there instead of linking a system
+// libuv whose version does not match the headers.
+#ifdef IMAGESEARCH_BENCH
+
+#include <pthread.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef pthread_t uv_thread_t;
+typedef pthread_mutex_t uv_mutex_t;
+typedef pthread_cond_t uv_cond_t;
+
+typedef struct {
+    void (*entry)(void *arg);
+    void *arg;
+} ThreadStart;
+
+static inline void *threadStart(void *arg) {
+    ThreadStart start = *static_cast<ThreadStart*>(arg);
+    delete static_cast<ThreadStart*>(arg);
+    
+    start.entry(start.arg);
+    
+    return NULL;
+}
+
+static inline int uv_thread_create(uv_thread_t *tid, void (*entry)(void *arg), void *arg) {
+    ThreadStart *start = new ThreadStart;
+    start->entry = entry;
+    start->arg = arg;
+    
+    const int err = pthread_create(tid, NULL, threadStart, start);
+    if (err) {
+        delete start;
+    }
+    
+    return err;
+}
+
+static inline int uv_thread_join(uv_thread_t *tid) {
+    return pthread_join(*tid, NULL);
+}
+
+static inline int uv_mutex_init(uv_mutex_t *mutex) {
+    return pthread_mutex_init(mutex, NULL);
+}
+
+static inline void uv_mutex_destroy(uv_mutex_t *mutex) {
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void uv_mutex_lock(uv_mutex_t *mutex) {
+    pthread_mutex_lock(mutex);
+}
+
+static inline void uv_mutex_unlock(uv_mutex_t *mutex) {
+    pthread_mutex_unlock(mutex);
+}
+
+static inline int uv_cond_init(uv_cond_t *cond) {
+    return pthread_cond_init(cond, NULL);
+}
+
+static inline void uv_cond_destroy(uv_cond_t *cond) {
+    pthread_cond_destroy(cond);
+}
+
+static inline void uv_cond_signal(uv_cond_t *cond) {
+    pthread_cond_signal(cond);
+}
+
+static inline void uv_cond_broadcast(uv_cond_t *cond) {
+    pthread_cond_broadcast(cond);
+}
+
+static inline void uv_cond_wait(uv_cond_t *cond, uv_mutex_t *mutex) {
+    pthread_cond_wait(cond, mutex);
+}
+
+// monotonic nanoseconds, as uv_hrtime()
+static inline uint64_t uv_hrtime() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    
+    return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+#else
+
+#include <uv.h>
+
+#endif
+
+#endif